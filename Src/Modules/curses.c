@@ -720,34 +720,22 @@ zccmd_clear(const char *nam, char **args)
 
 
 static int
-zccmd_char(const char *nam, char **args)
+zcurses_addchar(WINDOW *win, char *str)
 {
-    LinkNode node;
-    ZCWin w;
 #ifdef HAVE_SETCCHAR
     wchar_t c;
     cchar_t cc;
-#endif
-
-    node = zcurses_validate_window(args[0], ZCURSES_USED);
-    if (node == NULL) {
-	zwarnnam(nam, "%s: %s", zcurses_strerror(zc_errno), args[0]);
-	return 1;
-    }
-
-    w = (ZCWin)getdata(node);
 
-#ifdef HAVE_SETCCHAR
-    if (mbrtowc(&c, args[1], MB_CUR_MAX, NULL) < 1)
+    if (mbrtowc(&c, str, MB_CUR_MAX, NULL) < 1)
 	return 1;
 
     if (setcchar(&cc, &c, A_NORMAL, 0, NULL)==ERR)
 	return 1;
 
-    if (wadd_wch(w->win, &cc)!=OK)
+    if (wadd_wch(win, &cc)!=OK)
 	return 1;
 #else
-    if (waddch(w->win, (chtype)args[1][0])!=OK)
+    if (waddch(win, (chtype)str[0])!=OK)
 	return 1;
 #endif
 
@@ -756,18 +744,11 @@ zccmd_char(const char *nam, char **args)
 
 
 static int
-zccmd_string(const char *nam, char **args)
+zccmd_char(const char *nam, char **args)
 {
     LinkNode node;
     ZCWin w;
 
-#ifdef HAVE_WADDWSTR
-    int clen;
-    wint_t wc;
-    wchar_t *wstr, *wptr;
-    char *str = args[1];
-#endif
-
     node = zcurses_validate_window(args[0], ZCURSES_USED);
     if (node == NULL) {
 	zwarnnam(nam, "%s: %s", zcurses_strerror(zc_errno), args[0]);
@@ -776,7 +757,18 @@ zccmd_string(const char *nam, char **args)
 
     w = (ZCWin)getdata(node);
 
+    return zcurses_addchar(w->win, args[1]);
+}
+
+
+static int
+zcurses_addstring(WINDOW *win, char *str)
+{
 #ifdef HAVE_WADDWSTR
+    int clen;
+    wint_t wc;
+    wchar_t *wstr, *wptr;
+
     mb_charinit();
     wptr = wstr = zhalloc((strlen(str)+1) * sizeof(wchar_t));
 
@@ -787,17 +779,35 @@ zccmd_string(const char *nam, char **args)
 	*wptr++ = wc;
     }
     *wptr++ = L'\0';
-    if (waddwstr(w->win, wstr)!=OK) {
+    if (waddwstr(win, wstr)!=OK) {
 	return 1;
     }
 #else
-    if (waddstr(w->win, args[1])!=OK)
+    if (waddstr(win, str)!=OK)
 	return 1;
 #endif
     return 0;
 }
 
 
+static int
+zccmd_string(const char *nam, char **args)
+{
+    LinkNode node;
+    ZCWin w;
+
+    node = zcurses_validate_window(args[0], ZCURSES_USED);
+    if (node == NULL) {
+	zwarnnam(nam, "%s: %s", zcurses_strerror(zc_errno), args[0]);
+	return 1;
+    }
+
+    w = (ZCWin)getdata(node);
+
+    return zcurses_addstring(w->win, args[1]);
+}
+
+
 static int
 zccmd_border(const char *nam, char **args)
 {
@@ -839,6 +849,53 @@ zccmd_endwin(UNUSED(const char *nam), UNUSED(char **args))
 }
 
 
+static int
+zcurses_setattr(const char *nam, WINDOW *win, char *attr)
+{
+    if (strchr(attr, '/')) {
+	Colorpairnode cpn;
+	if ((cpn = zcurses_colorget(nam, attr)) == NULL ||
+	    wcolor_set(win, cpn->colorpair, NULL) == ERR)
+	    return 1;
+    } else {
+	char *ptr;
+	int onoff;
+	struct zcurses_namenumberpair *zca;
+
+	switch(attr[0]) {
+	case '-':
+	    onoff = ZCURSES_ATTROFF;
+	    ptr = attr + 1;
+	    break;
+	case '+':
+	    onoff = ZCURSES_ATTRON;
+	    ptr = attr + 1;
+	    break;
+	default:
+	    onoff = ZCURSES_ATTRON;
+	    ptr = attr;
+	    break;
+	}
+	if ((zca = zcurses_attrget(win, ptr)) == NULL) {
+	    zwarnnam(nam, "attribute `%s' not known", ptr);
+	    return 1;
+	} else {
+	    switch(onoff) {
+		case ZCURSES_ATTRON:
+		    if (wattron(win, zca->number) == ERR)
+			return 1;
+		    break;
+		case ZCURSES_ATTROFF:
+		    if (wattroff(win, zca->number) == ERR)
+			return 1;
+		    break;
+	    }
+	}
+    }
+    return 0;
+}
+
+
 static int
 zccmd_attr(const char *nam, char **args)
 {
@@ -859,51 +916,183 @@ zccmd_attr(const char *nam, char **args)
     w = (ZCWin)getdata(node);
 
     for(attrs = args+1; *attrs; attrs++) {
-	if (strchr(*attrs, '/')) {
-	    Colorpairnode cpn;
-	    if ((cpn = zcurses_colorget(nam, *attrs)) == NULL ||
-		wcolor_set(w->win, cpn->colorpair, NULL) == ERR)
-		ret = 1;
-	} else {
-	    char *ptr;
-	    int onoff;
-	    struct zcurses_namenumberpair *zca;
+	if (zcurses_setattr(nam, w->win, *attrs))
+	    ret = 1;
+    }
+    return ret;
+}
 
-	    switch(*attrs[0]) {
-	    case '-':
-		onoff = ZCURSES_ATTROFF;
-		ptr = (*attrs) + 1;
-		break;
-	    case '+':
-		onoff = ZCURSES_ATTRON;
-		ptr = (*attrs) + 1;
-		break;
-	    default:
-		onoff = ZCURSES_ATTRON;
-		ptr = *attrs;
+
+/*
+ * Apply a list of drawing operations to a window, then update the
+ * screen once at the end.  Curses errors from individual operations
+ * make the status 1 but don't stop the rest.
+ */
+
+static int
+zccmd_draw(const char *nam, char **args)
+{
+    LinkNode node;
+    ZCWin w;
+    char **op;
+    int ret = 0;
+
+    node = zcurses_validate_window(args[0], ZCURSES_USED);
+    if (node == NULL) {
+	zwarnnam(nam, "%s: %s", zcurses_strerror(zc_errno), args[0]);
+	return 1;
+    }
+
+    w = (ZCWin)getdata(node);
+
+    for (op = args+1; *op; ) {
+	char *opnam = *op++;
+	int nopargs = !strcmp(opnam, "move") ? 2 : 1;
+
+	if (arrlen_lt(op, nopargs)) {
+	    zwarnnam(nam, "draw: too few arguments for `%s'", opnam);
+	    ret = 1;
+	    break;
+	}
+	if (!strcmp(opnam, "move")) {
+	    if (wmove(w->win, atoi(op[0]), atoi(op[1])) != OK)
+		ret = 1;
+	} else if (!strcmp(opnam, "string")) {
+	    if (zcurses_addstring(w->win, op[0]))
+		ret = 1;
+	} else if (!strcmp(opnam, "char")) {
+	    if (zcurses_addchar(w->win, op[0]))
+		ret = 1;
+	} else if (!strcmp(opnam, "attr")) {
+	    if (zcurses_setattr(nam, w->win, op[0]))
+		ret = 1;
+	} else if (!strcmp(opnam, "clear")) {
+	    int cret;
+
+	    if (!strcmp(op[0], "all"))
+		cret = werase(w->win);
+	    else if (!strcmp(op[0], "eol"))
+		cret = wclrtoeol(w->win);
+	    else if (!strcmp(op[0], "bot"))
+		cret = wclrtobot(w->win);
+	    else {
+		zwarnnam(nam, "draw: `clear' expects `all', `eol' or `bot'");
+		ret = 1;
 		break;
 	    }
-	    if ((zca = zcurses_attrget(w->win, ptr)) == NULL) {
-		zwarnnam(nam, "attribute `%s' not known", ptr);
+	    if (cret != OK)
 		ret = 1;
-	    } else {
-		switch(onoff) {
-		    case ZCURSES_ATTRON:
-			if (wattron(w->win, zca->number) == ERR)
-			    ret = 1;
-			break;
-		    case ZCURSES_ATTROFF:
-			if (wattroff(w->win, zca->number) == ERR)
-			    ret = 1;
-			break;
-		}
-	    }
+	} else {
+	    zwarnnam(nam, "draw: unknown operation: %s", opnam);
+	    ret = 1;
+	    break;
 	}
+	op += nopargs;
     }
+
+    if (w->parent) {
+	/* As for refresh. */
+	touchwin(w->parent->win);
+    }
+    if (wnoutrefresh(w->win) != OK || doupdate() != OK)
+	ret = 1;
     return ret;
 }
 
 
+/*
+ * Wait for input on the terminal, or any of the file descriptors
+ * given, for up to timeout milliseconds.  The descriptors that are
+ * ready are returned in $reply.
+ */
+
+static int
+zccmd_poll(const char *nam, char **args)
+{
+#ifdef HAVE_SELECT
+    fd_set fds;
+    struct timeval tv, *tvp = NULL;
+    int to, fd, fdmax, ttyfd = fileno(stdin), ret;
+    char *eptr, **fdarg;
+    zlong start = 0;
+    LinkList ready;
+
+    to = (int)zstrtol(args[0], &eptr, 10);
+    if (*eptr) {
+	zwarnnam(nam, "poll requires an integer timeout: %s", args[0]);
+	return 1;
+    }
+    for (fdarg = args+1; *fdarg; fdarg++) {
+	fd = (int)zstrtol(*fdarg, &eptr, 10);
+	if (!idigit(**fdarg) || *eptr || fd >= FD_SETSIZE) {
+	    zwarnnam(nam, "expecting file descriptor: %s", *fdarg);
+	    return 1;
+	}
+    }
+    if (to >= 0) {
+	struct timespec now;
+
+	zgettime(&now);
+	start = (zlong)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	tvp = &tv;
+    }
+
+    for (;;) {
+	FD_ZERO(&fds);
+	FD_SET(ttyfd, &fds);
+	fdmax = ttyfd + 1;
+	for (fdarg = args+1; *fdarg; fdarg++) {
+	    fd = atoi(*fdarg);
+	    FD_SET(fd, &fds);
+	    if (fd + 1 > fdmax)
+		fdmax = fd + 1;
+	}
+	if (tvp) {
+	    struct timespec now;
+	    zlong left;
+
+	    zgettime(&now);
+	    left = to - ((zlong)now.tv_sec * 1000 + now.tv_nsec / 1000000 -
+			 start);
+	    if (left < 0)
+		left = 0;
+	    tv.tv_sec = left / 1000;
+	    tv.tv_usec = (left % 1000) * 1000;
+	}
+	ret = select(fdmax, (SELECT_ARG_2_T)&fds, NULL, NULL, tvp);
+	if (ret >= 0 || errno != EINTR || errflag || retflag || breaks ||
+	    exit_pending)
+	    break;
+    }
+    if (ret < 0) {
+	if (errno != EINTR)
+	    zwarnnam(nam, "poll: %e", errno);
+	return 1;
+    }
+
+    ready = newlinklist();
+    if (FD_ISSET(ttyfd, &fds)) {
+	char digits[DIGBUFSIZE];
+
+	sprintf(digits, "%d", ttyfd);
+	addlinknode(ready, dupstring(digits));
+    }
+    for (fdarg = args+1; *fdarg; fdarg++) {
+	fd = atoi(*fdarg);
+	if (fd != ttyfd && FD_ISSET(fd, &fds)) {
+	    FD_CLR(fd, &fds);
+	    addlinknode(ready, dupstring(*fdarg));
+	}
+    }
+    if (!setaparam("reply", zlinklist2array(ready)))
+	return 1;
+    return ret == 0;
+#else
+    return 2;
+#endif
+}
+
+
 static int
 zccmd_bg(const char *nam, char **args)
 {
@@ -1584,6 +1773,8 @@ bin_zcurses(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
 	{"border", zccmd_border, 1, 1},
 	{"end", zccmd_endwin, 0, 0},
 	{"attr", zccmd_attr, 2, -1},
+	{"draw", zccmd_draw, 1, -1},
+	{"poll", zccmd_poll, 1, -1},
 	{"bg", zccmd_bg, 2, -1},
 	{"scroll", zccmd_scroll, 2, 2},
 	{"input", zccmd_input, 1, 4},
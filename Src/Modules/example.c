@@ -75,6 +75,64 @@ bin_example(char *nam, char **args, Options ops, UNUSED(int func))
     return 0;
 }
 
+/*
+ * Functions for the before_command and after_command hooks, added by
+ * "extrace" and deleted by "extrace -u", showing each command run.
+ */
+
+static int extracing;
+
+/**/
+static int
+ex_beforecmd(UNUSED(Hookdef d), void *data)
+{
+    struct cmdhookdata *cmd = (struct cmdhookdata *)data;
+    char *text = getpermtext(cmd->prog, cmd->pc, 0);
+
+#ifdef ZSH_64_BIT_TYPE
+    printf("before %s: %s\n", output64(cmd->lineno), text);
+#else
+    printf("before %ld: %s\n", cmd->lineno, text);
+#endif
+    fflush(stdout);
+    zsfree(text);
+    return 0;
+}
+
+/**/
+static int
+ex_aftercmd(UNUSED(Hookdef d), void *data)
+{
+    struct cmdhookdata *cmd = (struct cmdhookdata *)data;
+
+#ifdef ZSH_64_BIT_TYPE
+    printf("after %s: status %d\n", output64(cmd->lineno), cmd->status);
+#else
+    printf("after %ld: status %d\n", cmd->lineno, cmd->status);
+#endif
+    fflush(stdout);
+    return 0;
+}
+
+/**/
+static int
+bin_extrace(UNUSED(char *nam), UNUSED(char **args), Options ops,
+	    UNUSED(int func))
+{
+    if (OPT_ISSET(ops,'u')) {
+	if (extracing) {
+	    deletehookfunc("before_command", ex_beforecmd);
+	    deletehookfunc("after_command", ex_aftercmd);
+	    extracing = 0;
+	}
+    } else if (!extracing) {
+	addhookfunc("before_command", ex_beforecmd);
+	addhookfunc("after_command", ex_aftercmd);
+	extracing = 1;
+    }
+    return 0;
+}
+
 /**/
 static int
 cond_p_len(char **a, UNUSED(int id))
@@ -163,6 +221,7 @@ ex_wrapper(Eprog prog, FuncWrap w, char *name)
 
 static struct builtin bintab[] = {
     BUILTIN("example", 0, bin_example, 0, -1, 0, "flags", NULL),
+    BUILTIN("extrace", 0, bin_extrace, 0, 0, 0, "u", NULL),
 };
 
 static struct conddef cotab[] = {
@@ -234,6 +293,11 @@ boot_(Module m)
 int
 cleanup_(Module m)
 {
+    if (extracing) {
+	deletehookfunc("before_command", ex_beforecmd);
+	deletehookfunc("after_command", ex_aftercmd);
+	extracing = 0;
+    }
     deletewrapper(m, wrapper);
     return setfeatureenables(m, &module_features, NULL);
 }
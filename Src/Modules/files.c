@@ -350,6 +350,391 @@ domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
     return 0;
 }
 
+/* zf_batch builtin */
+
+/*
+ * zf_batch carries out a whole list of renames, links or copies,
+ * given as source/target pairs, as zmv wants.  Everything is checked
+ * before anything is touched, so that a clash anywhere leaves the
+ * files alone.  A pair whose target is the source of another pair is
+ * run after that pair, and a cycle is broken by putting the first
+ * source aside under a temporary name.
+ */
+
+#define BIN_CP 2
+
+#define BATCH_SYMLINK	(1<<6)
+
+#define BATCH_TODO	0
+#define BATCH_ACTIVE	1
+#define BATCH_DONE	2
+
+struct batchop {
+    char *src;			/* source, metafied */
+    char *tgt;			/* target, metafied */
+    int state;			/* BATCH_TODO etc. */
+};
+
+struct batchnode {
+    struct hashnode node;
+    int idx;			/* index into the array of batchops */
+};
+
+/**/
+static void
+batch_freenode(UNUSED(HashNode hn))
+{
+}
+
+/**/
+static HashTable
+batch_newtable(int size)
+{
+    HashTable ht = newhashtable(size, "zf_batch", NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = batch_freenode;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
+/* Return the index stored under nam, or -1. */
+
+/**/
+static int
+batch_lookup(HashTable ht, char *nam)
+{
+    struct batchnode *bn = (struct batchnode *) ht->getnode2(ht, nam);
+
+    return bn ? bn->idx : -1;
+}
+
+/**/
+static void
+batch_add(HashTable ht, char *nam, int idx)
+{
+    struct batchnode *bn = (struct batchnode *) zhalloc(sizeof(*bn));
+
+    bn->node.flags = 0;
+    bn->idx = idx;
+    ht->addnode(ht, nam, bn);
+}
+
+/*
+ * Copy the contents of the file p to q as cp does; an existing q
+ * keeps its mode.  The names are unmetafied.  Returns -1 with errno
+ * set on failure.
+ */
+
+/**/
+static int
+batch_copy(char *p, char *q)
+{
+    struct stat st, qst;
+    int in, out, ret = -1, e;
+    ssize_t len;
+    char buf[8192];
+#ifdef HAVE_COPY_FILE_RANGE
+    int range = 1;
+#endif
+
+    if ((in = open(p, O_RDONLY|O_NOCTTY)) < 0)
+	return -1;
+    if (fstat(in, &st) < 0)
+	out = -1;
+    else if (S_ISDIR(st.st_mode)) {
+	errno = EISDIR;
+	out = -1;
+    } else
+	out = open(q, O_WRONLY|O_CREAT|O_NOCTTY, st.st_mode & 0777);
+    if (out < 0) {
+	e = errno;
+	close(in);
+	errno = e;
+	return -1;
+    }
+    /* don't truncate the source if the target is the same file */
+    if (fstat(out, &qst) < 0)
+	goto done;
+    if (qst.st_dev == st.st_dev && qst.st_ino == st.st_ino) {
+	errno = EINVAL;
+	goto done;
+    }
+    if (ftruncate(out, 0) < 0)
+	goto done;
+    for (;;) {
+#ifdef HAVE_COPY_FILE_RANGE
+	if (range) {
+	    len = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+	    if (len < 0 && (errno == EINVAL || errno == EXDEV ||
+			    errno == ENOSYS || errno == EOPNOTSUPP)) {
+		range = 0;
+		continue;
+	    }
+	} else
+#endif
+	if ((len = read(in, buf, sizeof(buf))) > 0 &&
+	    write_loop(out, buf, len) < 0)
+	    goto done;
+	if (len < 0) {
+	    if (errno == EINTR)
+		continue;
+	    goto done;
+	}
+	if (len == 0)
+	    break;
+    }
+    ret = 0;
+ done:
+    e = errno;
+    close(in);
+    if (close(out) < 0 && !ret) {
+	e = errno;
+	ret = -1;
+    }
+    errno = e;
+    return ret;
+}
+
+/* Carry out one operation from p to q, both unmetafied. */
+
+/**/
+static int
+batch_doone(int func, int flags, char *p, char *q)
+{
+    struct stat st;
+
+    switch (func) {
+    case BIN_MV:
+	return rename(p, q);
+
+    case BIN_CP:
+	return batch_copy(p, q);
+
+    default:
+	if ((flags & MV_FORCE) && !lstat(q, &st) && !S_ISDIR(st.st_mode))
+	    unlink(q);
+#ifdef HAVE_LSTAT
+	if (flags & BATCH_SYMLINK)
+	    return symlink(p, q);
+#endif
+	return link(p, q);
+    }
+}
+
+/*
+ * A rename across devices is left to the external mv, which knows
+ * how to move directories and symbolic links and keep timestamps and
+ * the rest.  It reports its own errors.  It is run directly rather
+ * than as a shell command, so neither the names nor $? are touched.
+ * SIGCHLD stays blocked until it has been waited for, else the
+ * shell's handler could reap it first.
+ */
+
+/**/
+static int
+batch_xmv(char *p, char *q)
+{
+    char *argv[5];
+    pid_t pid, ret;
+    int status;
+
+    argv[0] = "mv";
+    argv[1] = "--";
+    argv[2] = unmetafy(dupstring(p), NULL);
+    argv[3] = unmetafy(dupstring(q), NULL);
+    argv[4] = NULL;
+
+    child_block();
+    if ((pid = fork()) == -1) {
+	child_unblock();
+	zwarnnam("zf_batch", "%s: can't run mv: %e", p, errno);
+	return 1;
+    } else if (!pid) {
+	child_unblock();
+	closem(FDT_INTERNAL, 0);
+	execvp(argv[0], argv);
+	zwarnnam("zf_batch", "can't run mv: %e", errno);
+	_exit(127);
+    }
+    while ((ret = waitpid(pid, &status, 0)) == -1 && errno == EINTR)
+	;
+    child_unblock();
+    return ret == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/**/
+static int
+batch_run(char *nam, int func, int flags, char *p, char *q)
+{
+    char *up = unmetafy(dupstring(p), NULL);
+
+    if (!batch_doone(func, flags, up, unmeta(q)))
+	return 0;
+    if (func == BIN_MV && errno == EXDEV)
+	return batch_xmv(p, q);
+    zwarnnam(nam, "%s: %e", p, errno);
+    return 1;
+}
+
+/**/
+static int
+bin_batch(char *nam, char **args, Options ops, UNUSED(int func))
+{
+    struct batchop *bops;
+    struct stat st, sst;
+    HashTable srctab, tgttab;
+    int n, i, j, k, c, *stack, flags = 0, err = 0, failed;
+    char *p, *tmp;
+
+    if (OPT_ISSET(ops,'C') && OPT_ISSET(ops,'L')) {
+	zwarnnam(nam, "-C and -L are mutually exclusive");
+	return 1;
+    }
+    if (OPT_ISSET(ops,'s') && !OPT_ISSET(ops,'L')) {
+	zwarnnam(nam, "-s is only valid with -L");
+	return 1;
+    }
+    func = OPT_ISSET(ops,'C') ? BIN_CP : OPT_ISSET(ops,'L') ? BIN_LN : BIN_MV;
+    if (OPT_ISSET(ops,'f'))
+	flags |= MV_FORCE;
+    if (OPT_ISSET(ops,'s'))
+	flags |= BATCH_SYMLINK;
+    if ((n = arrlen(args)) % 2) {
+	zwarnnam(nam, "sources and targets must come in pairs");
+	return 1;
+    }
+    if (!(n /= 2))
+	return 0;
+
+    bops = (struct batchop *) zhalloc(n * sizeof(*bops));
+    srctab = batch_newtable(n + 1);
+    tgttab = batch_newtable(n + 1);
+    for (i = 0; i < n; i++) {
+	bops[i].src = args[2 * i];
+	bops[i].tgt = args[2 * i + 1];
+	bops[i].state = BATCH_TODO;
+	/*
+	 * A target that is an existing directory is one to put the
+	 * file into, unless this is a rename of the directory itself
+	 * (such as a change of case on a case-insensitive file system).
+	 */
+	if (!stat(unmeta(bops[i].tgt), &st) && S_ISDIR(st.st_mode) &&
+	    !(func == BIN_MV && !lstat(unmeta(bops[i].src), &sst) &&
+	      st.st_dev == sst.st_dev && st.st_ino == sst.st_ino)) {
+	    p = strrchr(bops[i].src, '/');
+	    bops[i].tgt = zhtricat(bops[i].tgt, "/",
+				   p ? p + 1 : bops[i].src);
+	}
+	if (!strcmp(bops[i].src, bops[i].tgt)) {
+	    /* nothing to do, and not a file that goes away */
+	    bops[i].state = BATCH_DONE;
+	} else if (batch_lookup(srctab, bops[i].src) >= 0) {
+	    zwarnnam(nam, "%s: given more than once", bops[i].src);
+	    err = 1;
+	} else
+	    batch_add(srctab, bops[i].src, i);
+    }
+    for (i = 0; i < n; i++) {
+	if ((j = batch_lookup(tgttab, bops[i].tgt)) >= 0) {
+	    zwarnnam(nam, "%s and %s both map to %s", bops[j].src,
+		     bops[i].src, bops[i].tgt);
+	    err = 1;
+	    continue;
+	}
+	batch_add(tgttab, bops[i].tgt, i);
+	if (lstat(unmeta(bops[i].tgt), &st))
+	    continue;
+	/* a file renamed away first is no obstacle */
+	if (func == BIN_MV && batch_lookup(srctab, bops[i].tgt) >= 0)
+	    continue;
+	if (!lstat(unmeta(bops[i].src), &sst) &&
+	    st.st_dev == sst.st_dev && st.st_ino == sst.st_ino) {
+	    if (func == BIN_MV)
+		continue;
+	    zwarnnam(nam, "%s and %s are the same file", bops[i].src,
+		     bops[i].tgt);
+	    err = 1;
+	} else if (!(flags & MV_FORCE)) {
+	    zwarnnam(nam, "%s: file exists", bops[i].tgt);
+	    err = 1;
+	} else if (S_ISDIR(st.st_mode) && func != BIN_MV) {
+	    zwarnnam(nam, "%s: cannot overwrite directory", bops[i].tgt);
+	    err = 1;
+	}
+    }
+    if (err) {
+	deletehashtable(srctab);
+	deletehashtable(tgttab);
+	return 1;
+    }
+
+    stack = (int *) zhalloc(n * sizeof(int));
+    for (i = 0; i < n && !errflag; i++) {
+	if (bops[i].state != BATCH_TODO)
+	    continue;
+	/*
+	 * Follow the chain of pairs each of whose source is the target
+	 * of the one before; they are carried out from the far end.
+	 */
+	for (k = 0, j = i; j >= 0 && bops[j].state == BATCH_TODO;
+	     j = batch_lookup(srctab, bops[j].tgt)) {
+	    bops[j].state = BATCH_ACTIVE;
+	    stack[k++] = j;
+	}
+	failed = 0;
+	tmp = NULL;
+	if (j >= 0 && bops[j].state == BATCH_ACTIVE &&
+	    !(flags & BATCH_SYMLINK)) {
+	    /*
+	     * A cycle, which can only lead back to i as no two targets
+	     * are the same.  Put the source of i aside until the rest
+	     * is done.
+	     */
+	    for (c = 0; c < 100; c++) {
+		tmp = zhalloc(strlen(bops[i].src) + 16);
+		sprintf(tmp, "%s~zf%d", bops[i].src, c);
+		if (lstat(unmeta(tmp), &st) && errno == ENOENT)
+		    break;
+		tmp = NULL;
+	    }
+	    if (!tmp)
+		zwarnnam(nam, "%s: no temporary name for cycle", bops[i].src);
+	    else if (batch_run(nam, func, flags, bops[i].src, tmp))
+		tmp = NULL;
+	    failed = !tmp;
+	}
+	while (k--) {
+	    j = stack[k];
+	    bops[j].state = BATCH_DONE;
+	    p = (k || !tmp) ? bops[j].src : tmp;
+	    if (failed) {
+		/* the target of this pair is still in use */
+		zwarnnam(nam, "%s: not done", bops[j].src);
+		err = 1;
+	    } else if ((failed = batch_run(nam, func, flags, p, bops[j].tgt)))
+		err = 1;
+	}
+	if (tmp && func != BIN_MV)
+	    unlink(unmeta(tmp));
+	else if (tmp && failed)
+	    zwarnnam(nam, "%s: left as %s", bops[i].src, tmp);
+    }
+    deletehashtable(srctab);
+    deletehashtable(tgttab);
+    return err;
+}
+
 /* general recursion */
 
 struct recursivecmd {
@@ -803,6 +1188,7 @@ static struct builtin bintab[] = {
     BUILTIN("rmdir", 0, bin_rmdir, 1, -1, 0,         NULL,    NULL),
     BUILTIN("sync",  0, bin_sync,  0,  0, 0,         NULL,    NULL),
     /* The "safe" zsh-only names */
+    BUILTIN("zf_batch", 0, bin_batch, 0, -1, 0,         "CfLs",   NULL),
     BUILTIN("zf_chgrp", 0, bin_chown, 2, -1, BIN_CHGRP, "hRs",    NULL),
     BUILTIN("zf_chmod", 0, bin_chmod, 2, -1, 0,         "Rs",    NULL),
     BUILTIN("zf_chown", 0, bin_chown, 2, -1, BIN_CHOWN, "hRs",    NULL),
@@ -0,0 +1,777 @@
+/*
+ * git.c - read the state of a git repository without running git
+ *
+ * This file is part of zsh, the Z shell.
+ *
+ * Copyright (c) 2020 The Zsh Development Group
+ * All rights reserved.
+ *
+ * Permission is hereby granted, without written agreement and without
+ * license or royalty fees, to use, copy, modify, and distribute this
+ * software and to distribute modified versions of this software for any
+ * purpose, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * In no event shall the Zsh Development Group be liable to any party for
+ * direct, indirect, special, incidental, or consequential damages arising
+ * out of the use of this software and its documentation, even if the Zsh
+ * Development Group have been advised of the possibility of such damage.
+ *
+ * The Zsh Development Group specifically disclaim any warranties,
+ * including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose.  The software
+ * provided hereunder is on an "as is" basis, and the Zsh Development
+ * Group have no obligation to provide maintenance, support, updates,
+ * enhancements, or modifications.
+ *
+ */
+
+struct gitfilecache;
+
+#include "git.mdh"
+#include "git.pro"
+
+/*
+ * This is not a reimplementation of git.  It reads just enough of a
+ * repository to answer the questions asked by vcs_info on every prompt.
+ * Whenever it finds something it doesn't understand, it says so with
+ * status 2, and the caller asks git itself.
+ */
+
+/* Status returned by subcommands */
+#define ZGIT_YES	0
+#define ZGIT_NO		1
+#define ZGIT_ASKGIT	2
+
+/* We only handle SHA-1 repositories */
+#define GIT_RAWSZ	20
+#define GIT_HEXSZ	40
+
+/* Maximum chain of symbolic refs, as in git */
+#define GIT_MAXSYMREFS	5
+
+/* Flags in index entries */
+#define CE_STAGEMASK	0x3000
+#define CE_EXTENDED	0x4000
+#define CE_VALID	0x8000
+#define CE_INTENT_TO_ADD	0x2000
+#define CE_SKIP_WORKTREE	0x4000
+
+#define GIT_BE16(p) (((unsigned)(p)[0] << 8) | (unsigned)(p)[1])
+#define GIT_BE32(p) (((unsigned)(p)[0] << 24) | ((unsigned)(p)[1] << 16) | \
+		     ((unsigned)(p)[2] << 8) | (unsigned)(p)[3])
+
+/*
+ * A file whose contents we keep between calls, as long as its
+ * stat information doesn't change.  git always replaces the index
+ * and packed-refs by renaming a new file into place, so this is safe.
+ */
+
+struct gitfilecache {
+    char *path;
+    struct stat st;
+    char *data;
+    size_t len;
+};
+
+static struct gitfilecache indexcache, packedcache;
+
+/**/
+static void
+freegitfilecache(struct gitfilecache *fc)
+{
+    if (fc->data) {
+	zsfree(fc->path);
+	zfree(fc->data, fc->len + 1);
+	fc->path = fc->data = NULL;
+    }
+}
+
+/*
+ * Return the contents of a regular file, NUL-terminated, and optionally
+ * its length and stat information.  If fc is NULL, the contents go on
+ * the heap, else they're cached in fc.  Returns NULL on failure.
+ */
+
+/**/
+static char *
+gitreadfile(const char *path, struct gitfilecache *fc, size_t *lenp,
+	    struct stat *stp)
+{
+    struct stat st;
+    char *buf;
+    size_t len = 0;
+    ssize_t got;
+    int fd;
+
+    if (fc && fc->data && !strcmp(fc->path, path) &&
+	!stat(path, &st) && st.st_dev == fc->st.st_dev &&
+	st.st_ino == fc->st.st_ino && st.st_size == fc->st.st_size &&
+	st.st_mtime == fc->st.st_mtime
+#ifdef GET_ST_MTIME_NSEC
+	&& GET_ST_MTIME_NSEC(st) == GET_ST_MTIME_NSEC(fc->st)
+#endif
+	) {
+	if (lenp)
+	    *lenp = fc->len;
+	if (stp)
+	    *stp = fc->st;
+	return fc->data;
+    }
+
+    if ((fd = open(path, O_RDONLY | O_NOCTTY)) < 0)
+	return NULL;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+	close(fd);
+	return NULL;
+    }
+    if (fc)
+	buf = (char *)zalloc(st.st_size + 1);
+    else
+	buf = (char *)zhalloc(st.st_size + 1);
+    while (len < (size_t)st.st_size) {
+	if ((got = read(fd, buf + len, st.st_size - len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (!got)
+	    break;
+	len += got;
+    }
+    close(fd);
+    if (len != (size_t)st.st_size) {
+	if (fc)
+	    zfree(buf, st.st_size + 1);
+	return NULL;
+    }
+    buf[len] = '\0';
+    if (fc) {
+	freegitfilecache(fc);
+	fc->path = ztrdup(path);
+	fc->st = st;
+	fc->data = buf;
+	fc->len = len;
+    }
+    if (lenp)
+	*lenp = len;
+    if (stp)
+	*stp = st;
+    return buf;
+}
+
+/* Remove trailing white space in place */
+
+/**/
+static char *
+gitchomp(char *s)
+{
+    char *e = s + strlen(s);
+
+    while (e > s && (e[-1] == '\n' || e[-1] == '\r' ||
+		     e[-1] == ' ' || e[-1] == '\t'))
+	*--e = '\0';
+    return s;
+}
+
+/* Test if the first len characters of s are lower case hex digits */
+
+/**/
+static int
+gitishex(const char *s, int len)
+{
+    for (; len; len--, s++)
+	if (!idigit(*s) && (*s < 'a' || *s > 'f'))
+	    return 0;
+    return 1;
+}
+
+/*
+ * Find the directory holding objects and shared refs: for a linked
+ * worktree this is the main repository, else it's gitdir itself.
+ */
+
+/**/
+static char *
+gitcommondir(char *gitdir)
+{
+    char *s = gitreadfile(dyncat(gitdir, "/commondir"), NULL, NULL, NULL);
+
+    if (!s || !*gitchomp(s))
+	return gitdir;
+    return *s == '/' ? s : zhtricat(gitdir, "/", s);
+}
+
+/*
+ * Check the repository is one we can read: SHA-1 objects, refs in
+ * files, and no relocated work tree.
+ */
+
+/**/
+static int
+gitformatok(char *common)
+{
+    struct stat st;
+    char *conf, *s;
+
+    if (!stat(dyncat(common, "/reftable"), &st))
+	return 0;
+    if ((conf = gitreadfile(dyncat(common, "/config"), NULL, NULL, NULL))) {
+	for (s = conf; *s; s++)
+	    *s = tolower((unsigned char) *s);
+	if (strstr(conf, "objectformat") || strstr(conf, "refstorage") ||
+	    strstr(conf, "worktree"))
+	    return 0;
+    }
+    return 1;
+}
+
+/* Test if dir looks like a git directory, as git does */
+
+/**/
+static int
+gitisgitdir(char *dir)
+{
+    struct stat st;
+    char *common;
+
+    if (stat(dyncat(dir, "/HEAD"), &st) || !S_ISREG(st.st_mode))
+	return 0;
+    common = gitcommondir(dir);
+    return !stat(dyncat(common, "/objects"), &st) && S_ISDIR(st.st_mode) &&
+	!stat(dyncat(common, "/refs"), &st) && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Find the git directory for dir/.git, which may be a directory
+ * or a file pointing to one.  Returns NULL if there is no .git,
+ * or sets *askgit if it's something we don't understand.
+ */
+
+/**/
+static char *
+gitdotgit(char *dir, int *askgit)
+{
+    struct stat st;
+    char *dotgit = zhtricat(strcmp(dir, "/") ? dir : "", "/", ".git");
+    char *link;
+
+    if (stat(dotgit, &st))
+	return NULL;
+    if (S_ISDIR(st.st_mode))
+	return gitisgitdir(dotgit) ? dotgit : NULL;
+    if (S_ISREG(st.st_mode) &&
+	(link = gitreadfile(dotgit, NULL, NULL, NULL)) &&
+	!strncmp(link, "gitdir: ", 8)) {
+	link = gitchomp(link + 8);
+	if (*link != '/')
+	    link = zhtricat(dir, "/", link);
+	if (gitisgitdir(link))
+	    return link;
+    }
+    *askgit = 1;
+    return NULL;
+}
+
+/* Is ref private to a worktree rather than shared? */
+
+/**/
+static int
+gitworktreeref(const char *ref)
+{
+    return strncmp(ref, "refs/", 5) ||
+	!strncmp(ref, "refs/worktree/", 14) ||
+	!strncmp(ref, "refs/bisect/", 12) ||
+	!strncmp(ref, "refs/rewritten/", 15);
+}
+
+/* Look up ref in packed-refs; return its object name or NULL */
+
+/**/
+static char *
+gitpackedref(char *common, char *ref)
+{
+    size_t len, reflen = strlen(ref);
+    char *data, *ptr, *end, *eol;
+
+    if (!(data = gitreadfile(dyncat(common, "/packed-refs"), &packedcache,
+			     &len, NULL)))
+	return NULL;
+    for (ptr = data, end = data + len; ptr < end; ptr = eol + 1) {
+	if (!(eol = memchr(ptr, '\n', end - ptr)))
+	    eol = end;
+	if ((size_t)(eol - ptr) == GIT_HEXSZ + 1 + reflen &&
+	    ptr[GIT_HEXSZ] == ' ' &&
+	    !memcmp(ptr + GIT_HEXSZ + 1, ref, reflen) &&
+	    gitishex(ptr, GIT_HEXSZ))
+	    return dupstrpfx(ptr, GIT_HEXSZ);
+    }
+    return NULL;
+}
+
+/*
+ * Find the object name ref refers to, following symbolic refs.
+ * Returns NULL if the ref doesn't exist; sets *askgit if we
+ * couldn't make sense of it.
+ */
+
+/**/
+static char *
+gitresolve(char *gitdir, char *common, char *ref, int *askgit)
+{
+    int depth;
+    char *s;
+
+    for (depth = 0; depth <= GIT_MAXSYMREFS; depth++) {
+	s = gitreadfile(zhtricat(gitworktreeref(ref) ? gitdir : common,
+				 "/", ref), NULL, NULL, NULL);
+	if (!s)
+	    return strncmp(ref, "refs/", 5) ? NULL : gitpackedref(common, ref);
+	gitchomp(s);
+	if (!strncmp(s, "ref: ", 5)) {
+	    ref = s + 5;
+	    continue;
+	}
+	if (strlen(s) == GIT_HEXSZ && gitishex(s, GIT_HEXSZ))
+	    return s;
+	break;
+    }
+    *askgit = 1;
+    return NULL;
+}
+
+/* Set REPLY to an unmetafied string */
+
+/**/
+static void
+gitsetreply(char *s)
+{
+    setsparam("REPLY", metafy(s, -1, META_DUP));
+}
+
+/*
+ * zgit gitdir [ dir ]: find the repository containing dir, by
+ * default the current directory, and set reply to the git directory
+ * and the top of the work tree.  Like git, stop at a file system
+ * boundary.
+ */
+
+/**/
+static int
+zgit_gitdir(char *dir)
+{
+#ifdef HAVE_REALPATH
+    static const char *gitenv[] = {
+	"GIT_DIR", "GIT_WORK_TREE", "GIT_COMMON_DIR",
+	"GIT_CEILING_DIRECTORIES", "GIT_DISCOVERY_ACROSS_FILESYSTEM", NULL
+    };
+    const char **ep;
+    char buf[PATH_MAX+1], *gitdir, *s, **arr;
+    struct stat st;
+    dev_t dev;
+    int askgit = 0;
+
+    for (ep = gitenv; *ep; ep++)
+	if (getenv(*ep))
+	    return ZGIT_ASKGIT;
+    if (!realpath(dir ? unmeta(dir) : ".", buf) || stat(buf, &st))
+	return ZGIT_ASKGIT;
+    dir = dupstring(buf);
+    dev = st.st_dev;
+    for (;;) {
+	if ((gitdir = gitdotgit(dir, &askgit)))
+	    break;
+	/* bare repositories, or we're inside .git: leave it to git */
+	if (askgit || gitisgitdir(dir))
+	    return ZGIT_ASKGIT;
+	if (!strcmp(dir, "/"))
+	    return ZGIT_NO;
+	s = strrchr(dir, '/');
+	if (s == dir)
+	    s[1] = '\0';
+	else
+	    *s = '\0';
+	if (stat(dir, &st))
+	    return ZGIT_ASKGIT;
+	if (st.st_dev != dev)
+	    return ZGIT_NO;
+    }
+    /* git refuses repositories owned by others unless configured */
+    if (stat(dir, &st) || st.st_uid != geteuid() ||
+	stat(gitdir, &st) || st.st_uid != geteuid() ||
+	!gitformatok(gitcommondir(gitdir)))
+	return ZGIT_ASKGIT;
+
+    arr = (char **)zalloc(3 * sizeof(char *));
+    arr[0] = metafy(gitdir, -1, META_DUP);
+    arr[1] = metafy(dir, -1, META_DUP);
+    arr[2] = NULL;
+    setaparam("reply", arr);
+    return ZGIT_YES;
+#else
+    return ZGIT_ASKGIT;
+#endif
+}
+
+/*
+ * zgit head gitdir: set REPLY to the ref HEAD points to, like
+ * `git symbolic-ref HEAD', or to the object name if HEAD is detached,
+ * in which case the status is 1.
+ */
+
+/**/
+static int
+zgit_head(char *gitdir)
+{
+    struct stat st;
+    char *head = dyncat(gitdir, "/HEAD"), *s;
+
+    if (lstat(head, &st) || !S_ISREG(st.st_mode) ||
+	!(s = gitreadfile(head, NULL, NULL, NULL)))
+	return ZGIT_ASKGIT;
+    gitchomp(s);
+    if (!strncmp(s, "ref: ", 5)) {
+	/* placeholder left by the reftable backend */
+	if (!strcmp(s + 5, "refs/heads/.invalid"))
+	    return ZGIT_ASKGIT;
+	gitsetreply(s + 5);
+	return ZGIT_YES;
+    }
+    if (strlen(s) == GIT_HEXSZ && gitishex(s, GIT_HEXSZ)) {
+	gitsetreply(s);
+	return ZGIT_NO;
+    }
+    return ZGIT_ASKGIT;
+}
+
+/*
+ * zgit rev gitdir [ ref ]: set REPLY to the object name of ref,
+ * default HEAD, like `git rev-parse --verify'.  The status is 1 if
+ * the ref doesn't exist, for example on an unborn branch.
+ */
+
+/**/
+static int
+zgit_rev(char *gitdir, char *ref)
+{
+    char *common = gitcommondir(gitdir), *sha;
+    int askgit = 0;
+
+    if (!gitformatok(common))
+	return ZGIT_ASKGIT;
+    sha = gitresolve(gitdir, common, ref ? ref : "HEAD", &askgit);
+    if (askgit)
+	return ZGIT_ASKGIT;
+    if (!sha)
+	return ZGIT_NO;
+    gitsetreply(sha);
+    return ZGIT_YES;
+}
+
+/*
+ * zgit key gitdir: set REPLY to a string which changes whenever the
+ * index or the commit at HEAD does.  Anything derived from those two
+ * alone, such as whether there are staged changes, can be cached
+ * under this key.
+ */
+
+/**/
+static int
+zgit_key(char *gitdir)
+{
+    char *common = gitcommondir(gitdir), *sha, buf[5 * DIGBUFSIZE];
+    struct stat st;
+    int askgit = 0;
+    long nsec = 0;
+
+    if (!gitformatok(common))
+	return ZGIT_ASKGIT;
+    sha = gitresolve(gitdir, common, "HEAD", &askgit);
+    if (askgit)
+	return ZGIT_ASKGIT;
+    if (stat(dyncat(gitdir, "/index"), &st))
+	memset(&st, 0, sizeof(st));
+#ifdef GET_ST_MTIME_NSEC
+    else
+	nsec = GET_ST_MTIME_NSEC(st);
+#endif
+    sprintf(buf, "%lu:%lu:%lu:%ld.%ld:", (unsigned long)st.st_dev,
+	    (unsigned long)st.st_ino, (unsigned long)st.st_size,
+	    (long)st.st_mtime, nsec);
+    gitsetreply(dyncat(buf, sha ? sha : "-"));
+    return ZGIT_YES;
+}
+
+/*
+ * Check a submodule's checked out commit is the one recorded in the
+ * index; changes inside it don't count, as with --ignore-submodules=dirty.
+ */
+
+/**/
+static int
+gitsubmoduleok(char *path, unsigned char *raw)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    char hex[GIT_HEXSZ + 1], *gitdir, *sha;
+    int i, askgit = 0;
+
+    if (!(gitdir = gitdotgit(path, &askgit)))
+	return !askgit;		/* not checked out: nothing to compare */
+    sha = gitresolve(gitdir, gitcommondir(gitdir), "HEAD", &askgit);
+    if (!sha)
+	return 0;
+    for (i = 0; i < GIT_RAWSZ; i++) {
+	hex[2*i] = hexdigits[raw[i] >> 4];
+	hex[2*i+1] = hexdigits[raw[i] & 0xf];
+    }
+    hex[GIT_HEXSZ] = '\0';
+    return !strcmp(hex, sha);
+}
+
+/*
+ * zgit unstaged gitdir topdir: status 0 if the stat information in
+ * the index shows no file in the work tree has changed, as a quick
+ * substitute for `git diff --quiet'.  Otherwise the status is 1, and
+ * the caller needs to ask git: files whose stat information changed
+ * may still have the same contents.  Entries git itself can't trust
+ * (racily clean ones) count as changed.
+ */
+
+/**/
+static int
+zgit_unstaged(char *gitdir, char *top)
+{
+    char *data, *end, *ptr, *nameptr, *name = NULL, *path;
+    unsigned char *ent;
+    size_t len, namelen = 0, namesize = 0;
+    unsigned int version, count, flags, eflags, mode;
+    unsigned long sec;
+    struct stat ist, st;
+
+    if (!gitformatok(gitcommondir(gitdir)) ||
+	!(data = gitreadfile(dyncat(gitdir, "/index"), &indexcache,
+			     &len, &ist)) ||
+	len < 12 + GIT_RAWSZ || memcmp(data, "DIRC", 4))
+	return ZGIT_ASKGIT;
+    ent = (unsigned char *)data;
+    version = GIT_BE32(ent + 4);
+    count = GIT_BE32(ent + 8);
+    if (version < 2 || version > 4)
+	return ZGIT_ASKGIT;
+    end = data + len - GIT_RAWSZ;
+    if (!strcmp(top, "/"))
+	top = "";
+
+    for (ptr = data + 12; count--; ) {
+	ent = (unsigned char *)ptr;
+	if (ptr + 62 > end)
+	    return ZGIT_ASKGIT;
+	mode = GIT_BE32(ent + 24);
+	flags = GIT_BE16(ent + 60);
+	eflags = 0;
+	nameptr = ptr + 62;
+	if (flags & CE_EXTENDED) {
+	    if (version < 3)
+		return ZGIT_ASKGIT;
+	    eflags = GIT_BE16(ent + 62);
+	    nameptr += 2;
+	}
+	if (version == 4) {
+	    /* prefix compressed: strip count from previous name, suffix */
+	    size_t strip, slen;
+	    unsigned char c;
+	    char *nul;
+
+	    if (nameptr >= end)
+		return ZGIT_ASKGIT;
+	    c = *nameptr++;
+	    strip = c & 127;
+	    while (c & 128) {
+		if (nameptr >= end)
+		    return ZGIT_ASKGIT;
+		c = *nameptr++;
+		strip = ((strip + 1) << 7) | (c & 127);
+	    }
+	    if (strip > namelen ||
+		!(nul = memchr(nameptr, '\0', end - nameptr)))
+		return ZGIT_ASKGIT;
+	    slen = nul - nameptr;
+	    if (namelen - strip + slen >= namesize) {
+		char *newname;
+
+		namesize = 2 * (namelen - strip + slen) + 64;
+		newname = (char *)zhalloc(namesize);
+		if (namelen)
+		    memcpy(newname, name, namelen);
+		name = newname;
+	    }
+	    namelen -= strip;
+	    memcpy(name + namelen, nameptr, slen + 1);
+	    namelen += slen;
+	    ptr = nul + 1;
+	} else {
+	    char *nul = memchr(nameptr, '\0', end - nameptr);
+
+	    if (!nul)
+		return ZGIT_ASKGIT;
+	    name = nameptr;
+	    namelen = nul - nameptr;
+	    ptr += ((nameptr - ptr) + namelen + 8) & ~7;
+	}
+
+	if (flags & CE_STAGEMASK)
+	    return ZGIT_NO;		/* unmerged */
+	if ((flags & CE_VALID) || (eflags & CE_SKIP_WORKTREE))
+	    continue;
+	if (eflags & CE_INTENT_TO_ADD)
+	    return ZGIT_NO;
+	path = zhtricat(top, "/", name);
+	if ((mode & S_IFMT) == 0160000) {
+	    if (!gitsubmoduleok(path, ent + 40))
+		return ZGIT_NO;
+	    continue;
+	}
+	if (lstat(path, &st))
+	    return ZGIT_NO;
+	switch (mode & S_IFMT) {
+	case S_IFLNK:
+	    if (!S_ISLNK(st.st_mode))
+		return ZGIT_NO;
+	    break;
+
+	case S_IFREG:
+	    if (!S_ISREG(st.st_mode) ||
+		!(st.st_mode & S_IXUSR) != !(mode & S_IXUSR))
+		return ZGIT_NO;
+	    break;
+
+	default:
+	    return ZGIT_ASKGIT;
+	}
+	sec = GIT_BE32(ent + 8);
+	if (sec != (unsigned long)(st.st_mtime & 0xffffffffUL) ||
+#ifdef GET_ST_MTIME_NSEC
+	    GIT_BE32(ent + 12) != (unsigned)GET_ST_MTIME_NSEC(st) ||
+#endif
+	    GIT_BE32(ent) != (unsigned)(st.st_ctime & 0xffffffffUL) ||
+#ifdef GET_ST_CTIME_NSEC
+	    GIT_BE32(ent + 4) != (unsigned)GET_ST_CTIME_NSEC(st) ||
+#endif
+	    GIT_BE32(ent + 20) != (unsigned)(st.st_ino & 0xffffffffUL) ||
+	    GIT_BE32(ent + 28) != (unsigned)st.st_uid ||
+	    GIT_BE32(ent + 32) != (unsigned)st.st_gid ||
+	    GIT_BE32(ent + 36) != (unsigned)(st.st_size & 0xffffffffUL))
+	    return ZGIT_NO;
+	/*
+	 * Racily clean: modified in the same second the index was
+	 * written, so the stat information proves nothing.
+	 */
+	if (sec >= (unsigned long)(ist.st_mtime & 0xffffffffUL))
+	    return ZGIT_NO;
+    }
+
+    /* split and sparse indexes don't list every file */
+    while (ptr + 8 <= end) {
+	if (!memcmp(ptr, "link", 4) || !memcmp(ptr, "sdir", 4))
+	    return ZGIT_ASKGIT;
+	ptr += 8 + GIT_BE32((unsigned char *)ptr + 4);
+    }
+    return ZGIT_YES;
+}
+
+/**/
+static int
+bin_zgit(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
+{
+    char *cmd = *args++;
+    int nargs = arrlen(args), minargs, maxargs, i;
+
+    if (!strcmp(cmd, "gitdir"))
+	minargs = 0, maxargs = 1;
+    else if (!strcmp(cmd, "head") || !strcmp(cmd, "key"))
+	minargs = maxargs = 1;
+    else if (!strcmp(cmd, "rev"))
+	minargs = 1, maxargs = 2;
+    else if (!strcmp(cmd, "unstaged"))
+	minargs = maxargs = 2;
+    else {
+	zwarnnam(nam, "unknown subcommand: %s", cmd);
+	return ZGIT_ASKGIT;
+    }
+    if (nargs < minargs || nargs > maxargs) {
+	zwarnnam(nam, "wrong number of arguments for %s", cmd);
+	return ZGIT_ASKGIT;
+    }
+    if (!strcmp(cmd, "gitdir"))
+	return zgit_gitdir(*args);
+
+    for (i = 0; i < nargs; i++)
+	args[i] = unmetafy(dupstring(args[i]), NULL);
+    switch (*cmd) {
+    case 'h':
+	return zgit_head(args[0]);
+    case 'k':
+	return zgit_key(args[0]);
+    case 'r':
+	return zgit_rev(args[0], args[1]);
+    default:
+	return zgit_unstaged(args[0], args[1]);
+    }
+}
+
+static struct builtin bintab[] = {
+    BUILTIN("zgit", 0, bin_zgit, 1, -1, 0, NULL, NULL),
+};
+
+static struct features module_features = {
+    bintab, sizeof(bintab)/sizeof(*bintab),
+    NULL, 0,
+    NULL, 0,
+    NULL, 0,
+    0
+};
+
+/**/
+int
+setup_(UNUSED(Module m))
+{
+    return 0;
+}
+
+/**/
+int
+features_(Module m, char ***features)
+{
+    *features = featuresarray(m, &module_features);
+    return 0;
+}
+
+/**/
+int
+enables_(Module m, int **enables)
+{
+    return handlefeatures(m, &module_features, enables);
+}
+
+/**/
+int
+boot_(UNUSED(Module m))
+{
+    return 0;
+}
+
+/**/
+int
+cleanup_(Module m)
+{
+    freegitfilecache(&indexcache);
+    freegitfilecache(&packedcache);
+    return setfeatureenables(m, &module_features, NULL);
+}
+
+/**/
+int
+finish_(UNUSED(Module m))
+{
+    return 0;
+}
@@ -37,13 +37,38 @@ struct cielab {
 };
 typedef struct cielab *Cielab;
 
+/* A colour in the terminal's palette, with its CIELAB value */
+struct palcolour {
+    int num;
+    struct cielab lab;
+};
+
+/*
+ * Most recent lookups, indexed by a hash of the RGB value.  Prompts and
+ * highlighting use the same few colours over and over again.
+ */
+struct nearcache {
+    unsigned int rgb;	/* RGB value with NEARCACHE_VALID, or 0 */
+    int num;
+};
+
+#define NEARCACHE_SIZE	1024
+#define NEARCACHE_VALID	(1U << 24)
+#define NEARCACHE_HASH(rgb) \
+    ((((rgb) * 2654435761U) & 0xffffffffU) >> 22)
+
+static struct palcolour pal88[72], pal256[240];
+static int npal88, npal256;
+static struct nearcache cache88[NEARCACHE_SIZE], cache256[NEARCACHE_SIZE];
+
 static double
 deltae(Cielab lab1, Cielab lab2)
 {
+    double dL = lab1->L - lab2->L, da = lab1->a - lab2->a;
+    double db = lab1->b - lab2->b;
+
     /* taking square root unnecessary as we're just comparing values */
-    return pow(lab1->L - lab2->L, 2) +
-	pow(lab1->a - lab2->a, 2) +
-	pow(lab1->b - lab2->b, 2);
+    return dL * dL + da * da + db * db;
 }
 
 static void
@@ -70,44 +95,33 @@ RGBtoLAB(int red, int green, int blue, Cielab lab)
     lab->b = 200.0 * (Y - Z);
 }
 
+/*
+ * Fill in the 72 colours of the 88 colour palette that aren't
+ * the basic 16, returning the number of entries.
+ */
 static int
-mapRGBto88(int red, int green, int blue)
+mkpalette88(struct palcolour *pal)
 {
     int component[] = { 0, 0x8b, 0xcd, 0xff, 0x2e, 0x5c, 0x8b, 0xa2, 0xb9, 0xd0, 0xe7 };
-    struct cielab orig, next;
-    double nextl, bestl = -1;
-    int r, g, b;
-    int comp_r = 0, comp_g = 0, comp_b = 0;
+    int r, g, b, n = 0;
 
-    /* Get original value */
-    RGBtoLAB(red, green, blue, &orig);
-
-    /* try every one of the 72 colours */
     for (r = 0; r < 11; r++) {
 	for (g = 0; g <= 3; g++) {
 	    for (b = 0; b <= 3; b++) {
 		if (r > 3) g = b = r; /* advance inner loops to the block of greys */
-		RGBtoLAB(component[r], component[g], component[b], &next);
-		nextl = deltae(&orig, &next);
-		if (nextl < bestl || bestl < 0) {
-		    bestl = nextl;
-		    comp_r = r;
-		    comp_g = g;
-		    comp_b = b;
-		}
+		RGBtoLAB(component[r], component[g], component[b], &pal[n].lab);
+		pal[n++].num = (r > 3) ? 77 + r : 16 + (r * 16) + (g * 4) + b;
 	    }
 	}
     }
-
-    return (comp_r > 3) ? 77 + comp_r :
-        16 + (comp_r * 16) + (comp_g * 4) + comp_b;
+    return n;
 }
 
 /*
- * Convert RGB to nearest colour in the 256 colour range
+ * Likewise for the 240 colours of the 256 colour palette
  */
 static int
-mapRGBto256(int red, int green, int blue)
+mkpalette256(struct palcolour *pal)
 {
     int component[] = {
 	0, 0x5f, 0x87, 0xaf, 0xd7, 0xff,
@@ -115,45 +129,76 @@ mapRGBto256(int red, int green, int blue)
 	0x58, 0x62, 0x6c, 0x76, 0x80, 0x8a, 0x94, 0x9e,
 	0xa8, 0xb2, 0xbc, 0xc6, 0xd0, 0xda, 0xe4, 0xee
     };
-    struct cielab orig, next;
-    double nextl, bestl = -1;
-    int r, g, b;
-    int comp_r = 0, comp_g = 0, comp_b = 0;
-
-    /* Get original value */
-    RGBtoLAB(red, green, blue, &orig);
+    int r, g, b, n = 0;
 
     for (r = 0; r < sizeof(component)/sizeof(*component); r++) {
 	for (g = 0; g <= 5; g++) {
 	    for (b = 0; b <= 5; b++) {
 		if (r > 5) g = b = r; /* advance inner loops to the block of greys */
-		RGBtoLAB(component[r], component[g], component[b], &next);
-		nextl = deltae(&orig, &next);
-		if (nextl < bestl || bestl < 0) {
-		    bestl = nextl;
-		    comp_r = r;
-		    comp_g = g;
-		    comp_b = b;
-		}
+		RGBtoLAB(component[r], component[g], component[b], &pal[n].lab);
+		pal[n++].num = (r > 5) ? 226 + r : 16 + (r * 36) + (g * 6) + b;
 	    }
 	}
     }
+    return n;
+}
+
+/*
+ * Convert RGB to the nearest colour in a palette.  Where two are
+ * equally close, the first wins.
+ */
+static int
+mapRGBtopalette(struct palcolour *pal, int npal, int red, int green, int blue)
+{
+    struct cielab orig;
+    double nextl, bestl = -1;
+    int i, best = 0;
 
-    return (comp_r > 5) ? 226 + comp_r :
-	16 + (comp_r * 36) + (comp_g * 6) + comp_b;
+    /* Get original value */
+    RGBtoLAB(red, green, blue, &orig);
+
+    for (i = 0; i < npal; i++) {
+	nextl = deltae(&orig, &pal[i].lab);
+	if (nextl < bestl || bestl < 0) {
+	    bestl = nextl;
+	    best = i;
+	}
+    }
+
+    return pal[best].num;
 }
 
 static int
 getnearestcolor(UNUSED(Hookdef dummy), Color_rgb col)
 {
+    unsigned int rgb = ((col->red & 0xff) << 16) | ((col->green & 0xff) << 8) |
+	(col->blue & 0xff);
+    struct nearcache *ent;
+
+    if (tccolours == 256) {
+	if (!npal256)
+	    npal256 = mkpalette256(pal256);
+	ent = cache256 + NEARCACHE_HASH(rgb);
+	if (ent->rgb != (rgb | NEARCACHE_VALID)) {
+	    ent->num = mapRGBtopalette(pal256, npal256,
+				       col->red, col->green, col->blue);
+	    ent->rgb = rgb | NEARCACHE_VALID;
+	}
+    } else if (tccolours == 88) {
+	if (!npal88)
+	    npal88 = mkpalette88(pal88);
+	ent = cache88 + NEARCACHE_HASH(rgb);
+	if (ent->rgb != (rgb | NEARCACHE_VALID)) {
+	    ent->num = mapRGBtopalette(pal88, npal88,
+				       col->red, col->green, col->blue);
+	    ent->rgb = rgb | NEARCACHE_VALID;
+	}
+    } else
+	return -1;
     /* we add 1 to the colours so that colour 0 (black) is
      * distinguished from runhookdef() indicating that no
      * hook function is registered */
-    if (tccolours == 256)
-	return mapRGBto256(col->red, col->green, col->blue) + 1;
-    if (tccolours == 88)
-	return mapRGBto88(col->red, col->green, col->blue) + 1;
-    return -1;
+    return ent->num + 1;
 }
 
 static struct features module_features = {
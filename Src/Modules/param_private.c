@@ -625,7 +625,7 @@ cleanup_(Module m)
     HashNode hn = builtintab->getnode(builtintab, "local");
     *(Builtin)hn = save_local;
 
-    removehashnode(reswdtab, "private");
+    reswdtab->removenode(reswdtab, "private");
     
     realparamtab->getnode = getparamnode;
     realparamtab->getnode2 = save_getnode2;
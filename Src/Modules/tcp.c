@@ -210,6 +210,29 @@ freehostent(UNUSED(struct hostent *ptr))
 
 static LinkList ztcp_sessions;
 
+/*
+ * Line framing for ztcpread.  Every fd read through it gets a buffer
+ * of what has been received but not yet handed back as lines, so the
+ * shell doesn't have to read a byte at a time to stop at a newline.
+ * The buffers go by fd rather than by session so that fds given to
+ * the TCP functions by hand work too.
+ */
+
+struct tcp_rbuf {
+    int fd;
+    int eof;			/* end of file or error seen */
+    char *buf;
+    int start, end;		/* unreturned data is buf[start..end-1] */
+    int size;			/* bytes allocated */
+};
+
+typedef struct tcp_rbuf *Tcp_rbuf;
+
+/* how much we try to read at once */
+#define TCP_RBUF_CHUNK 8192
+
+static LinkList ztcp_rbufs;
+
 /* "allocate" a tcp_session */
 static Tcp_session
 zts_alloc(int ztflags)
@@ -279,6 +302,152 @@ zts_byfd(int fd)
     return NULL;
 }
 
+static void
+tcp_rbuf_free(Tcp_rbuf rb)
+{
+    if (rb->buf)
+	zfree(rb->buf, rb->size);
+    zfree(rb, sizeof(struct tcp_rbuf));
+}
+
+static Tcp_rbuf
+tcp_rbuf_byfd(int fd, int create)
+{
+    LinkNode node;
+    Tcp_rbuf rb;
+
+    for (node = firstnode(ztcp_rbufs); node; incnode(node))
+	if (((Tcp_rbuf)getdata(node))->fd == fd)
+	    return (Tcp_rbuf)getdata(node);
+    if (!create)
+	return NULL;
+    rb = (Tcp_rbuf)zshcalloc(sizeof(struct tcp_rbuf));
+    rb->fd = fd;
+    zaddlinknode(ztcp_rbufs, rb);
+    return rb;
+}
+
+/* Forget anything buffered for an fd that's being closed or reused */
+static void
+tcp_rbuf_drop(int fd)
+{
+    LinkNode node;
+
+    for (node = firstnode(ztcp_rbufs); node; incnode(node))
+	if (((Tcp_rbuf)getdata(node))->fd == fd) {
+	    tcp_rbuf_free((Tcp_rbuf)remnode(ztcp_rbufs, node));
+	    return;
+	}
+}
+
+/* Read whatever is waiting on the fd into its buffer */
+static void
+tcp_rbuf_fill(Tcp_rbuf rb)
+{
+    ssize_t n;
+
+    if (rb->start) {
+	memmove(rb->buf, rb->buf + rb->start, rb->end - rb->start);
+	rb->end -= rb->start;
+	rb->start = 0;
+    }
+    if (rb->size - rb->end < TCP_RBUF_CHUNK) {
+	rb->buf = (char *)zrealloc(rb->buf, rb->end + TCP_RBUF_CHUNK);
+	rb->size = rb->end + TCP_RBUF_CHUNK;
+    }
+    do {
+	n = read(rb->fd, rb->buf + rb->end, rb->size - rb->end);
+    } while (n < 0 && errno == EINTR && !errflag);
+    if (n > 0)
+	rb->end += n;
+    else if (!n || (errno != EAGAIN && errno != EWOULDBLOCK))
+	rb->eof = 1;
+}
+
+/*
+ * Take the next complete line from the buffer, returning it metafied
+ * on the heap without its newline, or NULL if there isn't one.
+ * At end of file an unterminated last line counts as complete.
+ */
+static char *
+tcp_rbuf_line(Tcp_rbuf rb)
+{
+    char *ptr, *nl;
+    int len = rb->end - rb->start;
+
+    if (!len)
+	return NULL;
+    ptr = rb->buf + rb->start;
+    if ((nl = (char *)memchr(ptr, '\n', len))) {
+	len = nl - ptr;
+	rb->start += len + 1;
+    } else if (rb->eof)
+	rb->start = rb->end;
+    else
+	return NULL;
+    return metafy(ptr, len, META_HEAPDUP);
+}
+
+/* Whether tcp_rbuf_line() would return a line without reading more */
+static int
+tcp_rbuf_pending(Tcp_rbuf rb)
+{
+    int len;
+
+    if (!rb || !(len = rb->end - rb->start))
+	return 0;
+    return rb->eof || memchr(rb->buf + rb->start, '\n', len) != NULL;
+}
+
+/*
+ * Wait up to tmout milliseconds, or for ever if tmout is negative,
+ * for input on any of the n buffers not at end of file, and read
+ * what's there.  Returns as for poll().
+ */
+static int
+tcp_rbuf_wait(Tcp_rbuf *rbs, int n, int tmout)
+{
+    int i, ret;
+#ifdef HAVE_POLL
+    struct pollfd *fds = (struct pollfd *)zhalloc(n * sizeof(struct pollfd));
+    int nfds = 0;
+
+    for (i = 0; i < n; i++)
+	if (!rbs[i]->eof) {
+	    fds[nfds].fd = rbs[i]->fd;
+	    fds[nfds].events = POLLIN;
+	    fds[nfds].revents = 0;
+	    nfds++;
+	}
+    if ((ret = poll(fds, nfds, tmout)) <= 0)
+	return ret;
+    for (i = nfds = 0; i < n; i++)
+	if (!rbs[i]->eof && fds[nfds++].revents)
+	    tcp_rbuf_fill(rbs[i]);
+#else
+    fd_set rfds;
+    struct timeval tv;
+    int maxfd = 0;
+
+    FD_ZERO(&rfds);
+    for (i = 0; i < n; i++)
+	if (!rbs[i]->eof) {
+	    FD_SET(rbs[i]->fd, &rfds);
+	    if (rbs[i]->fd >= maxfd)
+		maxfd = rbs[i]->fd + 1;
+	}
+    tv.tv_sec = tmout / 1000;
+    tv.tv_usec = (tmout % 1000) * 1000;
+    if ((ret = select(maxfd, (SELECT_ARG_2_T) &rfds, NULL, NULL,
+		      tmout < 0 ? NULL : &tv)) <= 0)
+	return ret;
+    for (i = 0; i < n; i++)
+	if (!rbs[i]->eof && FD_ISSET(rbs[i]->fd, &rfds))
+	    tcp_rbuf_fill(rbs[i]);
+#endif
+    return ret;
+}
+
 static void
 tcp_cleanup(void)
 {
@@ -300,6 +469,7 @@ tcp_close(Tcp_session sess)
     {  
 	if (sess->fd != -1)
 	{
+	    tcp_rbuf_drop(sess->fd);
 	    err = zclose(sess->fd);
 	    if (err)
 		zwarn("connection close failed: %e", errno);
@@ -462,6 +632,7 @@ bin_ztcp(char *nam, char **args, Options ops, UNUSED(int func))
 	    return 1;
 	}
 
+	tcp_rbuf_drop(sess->fd);
 	setiparam_no_convert("REPLY", (zlong)sess->fd);
 
 	if (verbose)
@@ -563,6 +734,7 @@ bin_ztcp(char *nam, char **args, Options ops, UNUSED(int func))
 	    sess->fd = rfd;
 	}
 
+	tcp_rbuf_drop(sess->fd);
 	setiparam_no_convert("REPLY", (zlong)sess->fd);
 
 	if (verbose)
@@ -682,6 +854,7 @@ bin_ztcp(char *nam, char **args, Options ops, UNUSED(int func))
 		}
 	    }
 
+	    tcp_rbuf_drop(sess->fd);
 	    setiparam_no_convert("REPLY", (zlong)sess->fd);
 
 	    if (verbose)
@@ -695,8 +868,190 @@ bin_ztcp(char *nam, char **args, Options ops, UNUSED(int func))
     return 0;
 }
 
+/* Turn a timeout option in seconds into milliseconds, or -1 for error */
+static int
+ztcpread_tmout(char *nam, Options ops, int opt)
+{
+    mnumber mn = matheval(OPT_ARG(ops, opt));
+    double d;
+
+    if (errflag)
+	return -1;
+    d = (mn.type == MN_FLOAT) ? mn.u.d : (double)mn.u.l;
+    if (d < 0) {
+	zwarnnam(nam, "bad timeout: %s", OPT_ARG(ops, opt));
+	return -1;
+    }
+    return (int)(d * 1000 + 0.5);
+}
+
+static int
+bin_ztcpread(char *nam, char **args, Options ops, UNUSED(int func))
+{
+    int nfd = arrlen(args), npat = 0, i, j, ret = 2, matched = 0;
+    int drain = OPT_ISSET(ops,'d'), tmout = -1, tmall = -1;
+    int pending = OPT_ISSET(ops,'n');
+    Tcp_rbuf *rbs = (Tcp_rbuf *)zhalloc(nfd * sizeof(Tcp_rbuf));
+    Patprog *progs = NULL;
+    char **prefixes = NULL, *line, *arrnam;
+    struct timespec deadline;
+    LinkList got = newlinklist(), eofs = newlinklist();
+
+    if (OPT_ISSET(ops,'t') && (tmout = ztcpread_tmout(nam, ops, 't')) < 0)
+	return 1;
+    if (OPT_ISSET(ops,'T')) {
+	if ((tmall = ztcpread_tmout(nam, ops, 'T')) < 0)
+	    return 1;
+	zgettime(&deadline);
+	deadline.tv_sec += tmall / 1000;
+	deadline.tv_nsec += (tmall % 1000) * 1000000L;
+    }
+    for (i = 0; i < nfd; i++) {
+	char *eptr;
+	int fd = (int)zstrtol(args[i], &eptr, 10);
+
+	if (*eptr || fd < 0 || eptr == args[i]) {
+	    zwarnnam(nam, "bad file descriptor: %s", args[i]);
+	    return 1;
+	}
+	rbs[i] = tcp_rbuf_byfd(fd, !pending);
+    }
+    if (pending) {
+	/* Only say which fds have lines that poll() can't see */
+	for (i = 0; i < nfd; i++)
+	    if (tcp_rbuf_pending(rbs[i])) {
+		addlinknode(got, dupstring(args[i]));
+		ret = 0;
+	    }
+	arrnam = OPT_ISSET(ops,'a') ? OPT_ARG(ops,'a') : "reply";
+	setaparam(arrnam, zlinklist2array(got));
+	return ret ? 1 : 0;
+    }
+    if (OPT_ISSET(ops,'m')) {
+	char **pats = getaparam(OPT_ARG(ops,'m'));
+
+	if (!pats) {
+	    zwarnnam(nam, "no such array: %s", OPT_ARG(ops,'m'));
+	    return 1;
+	}
+	npat = arrlen(pats);
+	progs = (Patprog *)zhalloc(npat * sizeof(Patprog));
+	for (j = 0; j < npat; j++) {
+	    char *p = dupstring(pats[j]);
+
+	    tokenize(p);
+	    remnulargs(p);
+	    if (!(progs[j] = patcompile(p, 0, NULL))) {
+		zwarnnam(nam, "bad pattern: %s", pats[j]);
+		return 1;
+	    }
+	}
+	/* -p gives what goes in front of each line from an fd to match */
+	if (OPT_ISSET(ops,'p')) {
+	    prefixes = (char **)zhalloc(nfd * sizeof(char *));
+	    for (i = 0; i < nfd; i++) {
+		struct value vbuf;
+		Value v;
+		char *s = zhtricat(OPT_ARG(ops,'p'), "[",
+				   dyncat(args[i], "]"));
+
+		prefixes[i] = (v = getvalue(&vbuf, &s, 1)) ?
+		    getstrvalue(v) : NULL;
+	    }
+	}
+    }
+
+    /*
+     * Hand back what's buffered before waiting for more, since
+     * poll() can't see it.  Without -d or -m we're done as soon as
+     * there's a line; with -d, once nothing more is waiting; with -m,
+     * when a line matches.
+     */
+    for (;;) {
+	int alive = 0, ms, nready;
+
+	for (i = 0; i < nfd; i++) {
+	    while ((line = tcp_rbuf_line(rbs[i]))) {
+		addlinknode(got, dupstring(args[i]));
+		addlinknode(got, line);
+		if (progs) {
+		    char *str = (prefixes && prefixes[i]) ?
+			dyncat(prefixes[i], line) : line;
+
+		    for (j = 0; j < npat; j++)
+			if (pattry(progs[j], str)) {
+			    matched = j + 1;
+			    ret = 0;
+			    goto done;
+			}
+		} else {
+		    ret = 0;
+		    if (!drain)
+			goto done;
+		}
+	    }
+	    if (!rbs[i]->eof)
+		alive = 1;
+	}
+	if (!alive) {
+	    if (ret)
+		ret = 1;
+	    break;
+	}
+	if (!progs && !ret) {
+	    /* draining, so just take what's there already */
+	    ms = 0;
+	} else {
+	    ms = tmout;
+	    if (tmall >= 0) {
+		struct timespec now;
+		long left;
+
+		zgettime(&now);
+		left = (deadline.tv_sec - now.tv_sec) * 1000L +
+		    (deadline.tv_nsec - now.tv_nsec) / 1000000L;
+		if (left <= 0)
+		    break;
+		if (ms < 0 || left < ms)
+		    ms = (int)left;
+	    }
+	}
+	if ((nready = tcp_rbuf_wait(rbs, nfd, ms)) < 0) {
+	    if (errno == EINTR && !errflag)
+		continue;
+	    if (!errflag)
+		zwarnnam(nam, "poll error: %e", errno);
+	    ret = 1;
+	    break;
+	} else if (!nready)
+	    break;
+    }
+
+ done:
+    arrnam = OPT_ISSET(ops,'a') ? OPT_ARG(ops,'a') : "reply";
+    setaparam(arrnam, zlinklist2array(got));
+    if (progs)
+	setiparam("REPLY", matched);
+    /*
+     * Report fds with nothing more to give, and forget them in case
+     * the numbers get reused.
+     */
+    for (i = 0; i < nfd; i++)
+	if (rbs[i] && rbs[i]->eof && rbs[i]->start == rbs[i]->end) {
+	    addlinknode(eofs, dupstring(args[i]));
+	    tcp_rbuf_drop(rbs[i]->fd);
+	    for (j = i + 1; j < nfd; j++)
+		if (rbs[j] == rbs[i])
+		    rbs[j] = NULL;
+	}
+    if (OPT_ISSET(ops,'e'))
+	setaparam(OPT_ARG(ops,'e'), zlinklist2array(eofs));
+    return ret;
+}
+
 static struct builtin bintab[] = {
     BUILTIN("ztcp", 0, bin_ztcp, 0, 3, 0, "acd:flLtv", NULL),
+    BUILTIN("ztcpread", 0, bin_ztcpread, 1, -1, 0, "a:de:m:np:t:T:", NULL),
 };
 
 static struct features module_features = {
@@ -736,6 +1091,7 @@ int
 boot_(UNUSED(Module m))
 {
     ztcp_sessions = znewlinklist();
+    ztcp_rbufs = znewlinklist();
     return 0;
 }
 
@@ -746,6 +1102,7 @@ cleanup_(Module m)
 {
     tcp_cleanup();
     freelinklist(ztcp_sessions, (FreeFunc) ztcp_free_session);
+    freelinklist(ztcp_rbufs, (FreeFunc) tcp_rbuf_free);
     return setfeatureenables(m, &module_features, NULL);
 }
 
@@ -36,6 +36,9 @@
 #include "../../config.h"
 
 #include "termcap.mdh"
+
+struct tccap;
+
 #include "termcap.pro"
 
 /**/
@@ -49,6 +52,66 @@ static char *boolcodes[] = {
     "es", "hz", "ul", "xo", NULL};
 #endif
 
+/*
+ * Capabilities already looked up, and the output of echotc for
+ * capabilities with arguments, keyed by the capability name followed
+ * by the arguments.  Both are emptied when the terminal changes;
+ * the expansions also when there are too many of them.
+ */
+
+struct tccap {
+    struct hashnode node;
+    int type;			/* TCCAP_* */
+    int num;			/* value of a number or flag, or argument count */
+    char *str;			/* value of a string, or expansion */
+};
+
+#define TCCAP_NONE	0
+#define TCCAP_NUM	1
+#define TCCAP_FLAG	2
+#define TCCAP_STR	3
+
+#define TCEXP_MAX	128
+
+static HashTable tccaps, tcexps;
+static int tccapgen;
+
+/* Returned for a name that isn't a capability; type TCCAP_NONE */
+static struct tccap notccap;
+
+/**/
+static void
+freetccap(HashNode hn)
+{
+    struct tccap *tc = (struct tccap *)hn;
+
+    zsfree(tc->node.nam);
+    zsfree(tc->str);
+    zfree(tc, sizeof(struct tccap));
+}
+
+/**/
+static HashTable
+newtccaptable(int size, char const *name)
+{
+    HashTable ht = newhashtable(size, name, NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = freetccap;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
 /**/
 static int
 ztgetflag(char *s)
@@ -73,51 +136,85 @@ ztgetflag(char *s)
     return -1;
 }
 
+/* Look up a capability, in the same order as echotc */
+
+/**/
+static struct tccap *
+gettccap(char *name)
+{
+    struct tccap *tc;
+    char buf[2048], *u = buf, *t;
+    int num;
+
+    if (tccapgen != termgen) {
+	emptyhashtable(tccaps);
+	emptyhashtable(tcexps);
+	tccapgen = termgen;
+    }
+    if ((tc = (struct tccap *)gethashnode2(tccaps, name)))
+	return tc;
+
+    tc = (struct tccap *)zshcalloc(sizeof(struct tccap));
+    if ((num = tgetnum(name)) != -1) {
+	tc->type = TCCAP_NUM;
+	tc->num = num;
+    } else if ((num = ztgetflag(name)) != -1) {
+	tc->type = TCCAP_FLAG;
+	tc->num = num;
+    } else if ((t = tgetstr(name, &u)) != NULL && t != (char *)-1) {
+	tc->type = TCCAP_STR;
+	tc->str = ztrdup(t);
+	/* count the number of arguments required */
+	for (u = t; *u; u++)
+	    if (*u == '%') {
+		if (u++, (*u == 'd' || *u == '2' || *u == '3' || *u == '.' ||
+			  *u == '+'))
+		    tc->num++;
+	    }
+    } else {
+	/* Misses aren't kept: any number of names could be tried */
+	zfree(tc, sizeof(struct tccap));
+	return &notccap;
+    }
+    addhashnode(tccaps, ztrdup(name), tc);
+
+    return tc;
+}
+
 /* echotc: output a termcap */
 
 /**/
 static int
 bin_echotc(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
 {
-    char *s, buf[2048], *t, *u;
+    char *s, *t, **u, *key;
     int num, argct;
+    struct tccap *tc, *te;
 
     s = *argv++;
     if (termflags & TERM_BAD)
 	return 1;
     if ((termflags & TERM_UNKNOWN) && (isset(INTERACTIVE) || !init_term()))
 	return 1;
+    tc = gettccap(s);
     /* if the specified termcap has a numeric value, display it */
-    if ((num = tgetnum(s)) != -1) {
-	printf("%d\n", num);
+    if (tc->type == TCCAP_NUM) {
+	printf("%d\n", tc->num);
 	return 0;
     }
     /* if the specified termcap is boolean, and set, say so  */
-    switch (ztgetflag(s)) {
-    case -1:
-	break;
-    case 0:
-	puts("no");
-	return 0;
-    default:
-	puts("yes");
+    if (tc->type == TCCAP_FLAG) {
+	puts(tc->num ? "yes" : "no");
 	return 0;
     }
     /* get a string-type capability */
-    u = buf;
-    t = tgetstr(s, &u);
-    if (t == (char *)-1 || !t || !*t) {
+    t = tc->str;
+    if (!t || !*t) {
 	/* capability doesn't exist, or (if boolean) is off */
 	zwarnnam(name, "no such capability: %s", s);
 	return 1;
     }
-    /* count the number of arguments required */
-    for (argct = 0, u = t; *u; u++)
-	if (*u == '%') {
-	    if (u++, (*u == 'd' || *u == '2' || *u == '3' || *u == '.' ||
-		      *u == '+'))
-		argct++;
-	}
+    argct = tc->num;
     /* check that the number of arguments provided is correct */
     if (arrlen(argv) != argct) {
 	zwarnnam(name, (arrlen(argv) < argct) ? "not enough arguments" :
@@ -128,9 +225,20 @@ bin_echotc(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
     if (!argct)
 	tputs(t, 1, putraw);
     else {
-	/* This assumes arguments of <lines> <columns> for cap 'cm' */
-	num = (argv[1]) ? atoi(argv[1]) : atoi(*argv);
-	tputs(tgoto(t, num, atoi(*argv)), 1, putraw);
+	key = s;
+	for (u = argv; *u; u++)
+	    key = zhtricat(key, " ", *u);
+	if (!(te = (struct tccap *)gethashnode2(tcexps, key))) {
+	    if (tcexps->ct >= TCEXP_MAX)
+		emptyhashtable(tcexps);
+	    /* This assumes arguments of <lines> <columns> for cap 'cm' */
+	    num = (argv[1]) ? atoi(argv[1]) : atoi(*argv);
+	    te = (struct tccap *)zshcalloc(sizeof(struct tccap));
+	    te->type = TCCAP_STR;
+	    te->str = ztrdup(tgoto(t, num, atoi(*argv)));
+	    addhashnode(tcexps, ztrdup(key), te);
+	}
+	tputs(te->str, 1, putraw);
     }
     return 0;
 }
@@ -143,9 +251,10 @@ static struct builtin bintab[] = {
 static HashNode
 gettermcap(UNUSED(HashTable ht), const char *name)
 {
-    int len, num;
-    char *tcstr, buf[2048], *u, *nameu;
+    int len;
+    char *nameu;
     Param pm = NULL;
+    struct tccap *tc;
 
     /* This depends on the termcap stuff in init.c */
     if (termflags & TERM_BAD)
@@ -160,32 +269,21 @@ gettermcap(UNUSED(HashTable ht), const char *name)
     pm = (Param) hcalloc(sizeof(struct param));
     pm->node.nam = nameu;
     pm->node.flags = PM_READONLY;
-    u = buf;
 
-    /* logic in the following cascade copied from echotc, above */
-
-    if ((num = tgetnum(nameu)) != -1) {
+    tc = gettccap(nameu);
+    if (tc->type == TCCAP_NUM) {
 	pm->gsu.i = &nullsetinteger_gsu;
-	pm->u.val = num;
+	pm->u.val = tc->num;
 	pm->node.flags |= PM_INTEGER;
 	return &pm->node;
     }
 
     pm->gsu.s = &nullsetscalar_gsu;
-    switch (ztgetflag(nameu)) {
-    case -1:
-	break;
-    case 0:
-	pm->u.str = dupstring("no");
-	pm->node.flags |= PM_SCALAR;
-	return &pm->node;
-    default:
-	pm->u.str = dupstring("yes");
+    if (tc->type == TCCAP_FLAG) {
+	pm->u.str = dupstring(tc->num ? "yes" : "no");
 	pm->node.flags |= PM_SCALAR;
-	return &pm->node;
-    }
-    if ((tcstr = tgetstr(nameu, &u)) != NULL && tcstr != (char *)-1) {
-	pm->u.str = dupstring(tcstr);
+    } else if (tc->type == TCCAP_STR) {
+	pm->u.str = dupstring(tc->str);
 	pm->node.flags |= PM_SCALAR;
     } else {
 	/* zwarn("no such capability: %s", name); */
@@ -346,6 +444,9 @@ boot_(UNUSED(Module m))
 {
 #ifdef HAVE_TGETENT
     zsetupterm();
+    tccaps = newtccaptable(31, "tccaps");
+    tcexps = newtccaptable(31, "tcexps");
+    tccapgen = termgen;
 #endif
     return  0;
 }
@@ -355,6 +456,9 @@ int
 cleanup_(Module m)
 {
 #ifdef HAVE_TGETENT
+    deletehashtable(tccaps);
+    deletehashtable(tcexps);
+    tccaps = tcexps = NULL;
     zdeleteterm();
 #endif
     return setfeatureenables(m, &module_features, NULL);
@@ -36,6 +36,8 @@
 # undef USE_TERMINFO_MODULE
 #endif
 
+struct ticap;
+
 #include "terminfo.pro"
 
 /**/
@@ -57,14 +59,126 @@
 #  include "../zshterm.h"
 # endif
 
+/*
+ * Capabilities already looked up, and the output of echoti for
+ * capabilities with numeric arguments, keyed by the capability name
+ * followed by the arguments.  Both are emptied when the terminal
+ * changes; the expansions also when there are too many of them.
+ */
+
+struct ticap {
+    struct hashnode node;
+    int type;			/* TICAP_* */
+    int num;			/* value of a number or flag */
+    char *str;			/* value of a string, or expansion */
+};
+
+#define TICAP_NONE	0
+#define TICAP_NUM	1
+#define TICAP_FLAG	2
+#define TICAP_STR	3
+
+#define TIEXP_MAX	128
+
+static HashTable ticaps, tiexps;
+static int ticapgen;
+
+/* Returned for a name that isn't a capability; type TICAP_NONE */
+static struct ticap noticap;
+
+/**/
+static void
+freeticap(HashNode hn)
+{
+    struct ticap *tc = (struct ticap *)hn;
+
+    zsfree(tc->node.nam);
+    zsfree(tc->str);
+    zfree(tc, sizeof(struct ticap));
+}
+
+/**/
+static HashTable
+newticaptable(int size, char const *name)
+{
+    HashTable ht = newhashtable(size, name, NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = freeticap;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
+/* Forget everything cached if the terminal has changed */
+
+/**/
+static void
+checkticaps(void)
+{
+    if (ticapgen != termgen) {
+	emptyhashtable(ticaps);
+	emptyhashtable(tiexps);
+	ticapgen = termgen;
+    }
+}
+
+/* Look up a capability, in the same order as the terminfo parameter */
+
+/**/
+static struct ticap *
+getticap(char *name)
+{
+    struct ticap *tc;
+    char *tistr;
+    int num;
+
+    checkticaps();
+    if ((tc = (struct ticap *)gethashnode2(ticaps, name)))
+	return tc;
+
+    tc = (struct ticap *)zshcalloc(sizeof(struct ticap));
+    if (((num = tigetnum(name)) != -1) && (num != -2)) {
+	tc->type = TICAP_NUM;
+	tc->num = num;
+    } else if ((num = tigetflag(name)) != -1) {
+	tc->type = TICAP_FLAG;
+	tc->num = num;
+    } else if ((tistr = (char *)tigetstr(name)) != NULL &&
+	       tistr != (char *)-1) {
+	tc->type = TICAP_STR;
+	tc->str = ztrdup(tistr);
+    } else {
+	/*
+	 * Don't keep names that aren't capabilities, else looking up
+	 * made-up names would grow the table without limit.
+	 */
+	zfree(tc, sizeof(struct ticap));
+	return &noticap;
+    }
+    addhashnode(ticaps, ztrdup(name), tc);
+
+    return tc;
+}
+
 /* echoti: output a terminfo capability */
 
 /**/
 static int
 bin_echoti(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
 {
-    char *s, *t, **u;
-    int arg, num, strarg = 0;
+    char *s, *t, **u, *key;
+    int arg, strarg = 0;
+    struct ticap *tc, *te;
     long pars[] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
     char *strcap[] = { "pfkey", "pfloc", "pfx", "pln", "pfxl", NULL };
 
@@ -74,26 +188,20 @@ bin_echoti(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
 	return 1;
     if ((termflags & TERM_UNKNOWN) && (isset(INTERACTIVE) || !init_term()))
 	return 1;
+    tc = getticap(s);
     /* if the specified capability has a numeric value, display it */
-    if (((num = tigetnum(s)) != -1) && (num != -2)) {
-	printf("%d\n", num);
+    if (tc->type == TICAP_NUM) {
+	printf("%d\n", tc->num);
 	return 0;
     }
-
-    switch (tigetflag(s)) {
-    case -1:
-	break;
-    case 0:
-	puts("no");
-	return 0;
-    default:
-	puts("yes");
+    if (tc->type == TICAP_FLAG) {
+	puts(tc->num ? "yes" : "no");
 	return 0;
     }
 
 /* get a string-type capability */
-    t = (char *)tigetstr(s);
-    if (!t || t == (char *)-1 || !*t) {
+    t = tc->str;
+    if (!t || !*t) {
 	/* capability doesn't exist, or (if boolean) is off */
 	zwarnnam(name, "no such terminfo capability: %s", s);
 	return 1;
@@ -119,9 +227,27 @@ bin_echoti(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
     /* output string, through the proper termcap functions */
     if (!arg)
         putp(t);
-    else {
+    else if (strarg)
         putp(tparm(t, pars[0], pars[1], pars[2], pars[3], pars[4],
 	              pars[5], pars[6], pars[7], pars[8]));
+    else {
+	/* numeric arguments: remember the expansion for next time */
+	key = s;
+	for (u = argv; *u; u++)
+	    key = zhtricat(key, " ", *u);
+	if (!(te = (struct ticap *)gethashnode2(tiexps, key))) {
+	    if (tiexps->ct >= TIEXP_MAX)
+		emptyhashtable(tiexps);
+	    t = tparm(t, pars[0], pars[1], pars[2], pars[3], pars[4],
+		      pars[5], pars[6], pars[7], pars[8]);
+	    if (!t)
+		return 1;
+	    te = (struct ticap *)zshcalloc(sizeof(struct ticap));
+	    te->type = TICAP_STR;
+	    te->str = ztrdup(t);
+	    addhashnode(tiexps, ztrdup(key), te);
+	}
+	putp(te->str);
     }
     return 0;
 }
@@ -134,9 +260,10 @@ static struct builtin bintab[] = {
 static HashNode
 getterminfo(UNUSED(HashTable ht), const char *name)
 {
-    int len, num;
-    char *tistr, *nameu;
+    int len;
+    char *nameu;
     Param pm = NULL;
+    struct ticap *tc;
 
     /* This depends on the termcap stuff in init.c */
     if (termflags & TERM_BAD)
@@ -151,16 +278,17 @@ getterminfo(UNUSED(HashTable ht), const char *name)
     pm->node.nam = nameu;
     pm->node.flags = PM_READONLY;
 
-    if (((num = tigetnum(nameu)) != -1) && (num != -2)) {
-	pm->u.val = num;
+    tc = getticap(nameu);
+    if (tc->type == TICAP_NUM) {
+	pm->u.val = tc->num;
 	pm->node.flags |= PM_INTEGER;
 	pm->gsu.i = &nullsetinteger_gsu;
-    } else if ((num = tigetflag(nameu)) != -1) {
-	pm->u.str = num ? dupstring("yes") : dupstring("no");
+    } else if (tc->type == TICAP_FLAG) {
+	pm->u.str = tc->num ? dupstring("yes") : dupstring("no");
 	pm->node.flags |= PM_SCALAR;
 	pm->gsu.s = &nullsetscalar_gsu;
-    } else if ((tistr = (char *)tigetstr(nameu)) != NULL && tistr != (char *)-1) {
-	pm->u.str = dupstring(tistr);
+    } else if (tc->type == TICAP_STR) {
+	pm->u.str = dupstring(tc->str);
 	pm->node.flags |= PM_SCALAR;
 	pm->gsu.s = &nullsetscalar_gsu;
     } else {
@@ -339,6 +467,9 @@ boot_(UNUSED(Module m))
 {
 #ifdef USE_TERMINFO_MODULE
     zsetupterm();
+    ticaps = newticaptable(31, "ticaps");
+    tiexps = newticaptable(31, "tiexps");
+    ticapgen = termgen;
 #endif
 
     return 0;
@@ -349,6 +480,9 @@ int
 cleanup_(Module m)
 {
 #ifdef USE_TERMINFO_MODULE
+    deletehashtable(ticaps);
+    deletehashtable(tiexps);
+    ticaps = tiexps = NULL;
     zdeleteterm();
 #endif
     return setfeatureenables(m, &module_features, NULL);
@@ -41,6 +41,9 @@
  *   options to specify e.g. a non-standard port
  */
 
+/* this is defined so we get the prototype for splice */
+#define _GNU_SOURCE 1
+
 /* needed in prototypes for statics */
 struct hostent;
 struct in_addr;
@@ -68,6 +71,13 @@ typedef struct zftp_session *Zftp_session;
 #if defined(HAVE_POLL) && !defined(POLLIN) && !defined(POLLNORM)
 # undef HAVE_POLL
 #endif
+#if defined(HAVE_POLL) && defined(POLLIN) && defined(POLLOUT)
+/* Data connection timeouts use poll() rather than the alarm, see zfwait() */
+# define ZF_POLL
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 
 #ifdef USE_LOCAL_H_ERRNO
@@ -106,9 +116,9 @@ int h_errno;
  * we should handle blocks up to 65535 bytes, which
  * is pretty big, and should presumably send blocks
  * which are smaller to be on the safe side.
- * Currently we send 32768 and use that also as
- * the maximum to receive.  No-one's complained yet.  Of course,
- * no-one's *used* it yet apart from me, but even so.
+ * Currently we send 32768, or $ZFTP_BUFSIZE if that's smaller,
+ * and always allow the full 65535 when receiving.  No-one's complained
+ * yet.  Of course, no-one's *used* it yet apart from me, but even so.
  */
 
 struct zfheader {
@@ -867,6 +877,25 @@ zfopendata(char *name, union tcp_sockaddr *zdsockp, int *is_passivep)
 	zwarnnam(name, "can't get data socket: %e", errno);
 	return 1;
     }
+#if defined(SO_SNDBUF) && defined(SO_RCVBUF)
+    /*
+     * This has to happen before the connection is made for the
+     * TCP window to be scaled to match, so do it here rather than
+     * with the other options in zfgetdata().  A socket accepted from
+     * our listening one inherits the sizes.  If ZFTP_BUFSIZE isn't
+     * set we leave the system to tune the buffers itself.
+     */
+    {
+	int bufsize = (int)getiparam("ZFTP_BUFSIZE");
+
+	if (bufsize > 0) {
+	    setsockopt(zfsess->dfd, SOL_SOCKET, SO_SNDBUF,
+		       (char *)&bufsize, sizeof(bufsize));
+	    setsockopt(zfsess->dfd, SOL_SOCKET, SO_RCVBUF,
+		       (char *)&bufsize, sizeof(bufsize));
+	}
+    }
+#endif
 
     if (!(zfstatusp[zfsessno] & ZFST_NOPS) && (zfprefs & ZFPF_PASV)) {
 	char *psv_cmd;
@@ -1300,6 +1329,42 @@ zfendtrans(void)
     zfunsetparam("ZFTP_COUNT");
 }
 
+#ifdef ZF_POLL
+/*
+ * Wait up to tmout seconds for the data connection fd to be ready
+ * for the poll() events given.  Return 0 when it is, else -1 with
+ * errno set; a timeout sets zfdrrrring just as the alarm would.
+ *
+ * This is used in preference to the alarm for the data connection,
+ * since it doesn't need a signal handler swapped in and out for every
+ * block and it can't interrupt a transfer half way through a write.
+ * For the same reason the socket is made non-blocking when sending
+ * with a timeout, so a write can't outlast the poll().
+ */
+
+/**/
+static int
+zfwait(int fd, int events, int tmout)
+{
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = fd;
+    pfd.events = events;
+    if ((ret = poll(&pfd, 1, tmout * 1000)) > 0)
+	return 0;
+    if (!ret) {
+	zfdrrrring = 1;
+#ifdef ETIMEDOUT
+	errno = ETIMEDOUT;
+#else
+	errno = EIO;
+#endif
+    }
+    return -1;
+}
+#endif
+
 /* Read with timeout if recv is set. */
 
 /**/
@@ -1311,6 +1376,17 @@ zfread(int fd, char *bf, off_t sz, int tmout)
     if (!tmout)
 	return read(fd, bf, sz);
 
+#ifdef ZF_POLL
+    do {
+	if (zfwait(fd, POLLIN, tmout)) {
+	    if (zfdrrrring)
+		zwarnnam("zftp", "timeout on network read");
+	    return -1;
+	}
+    } while ((ret = read(fd, bf, sz)) < 0 &&
+	     (errno == EAGAIN || errno == EWOULDBLOCK));
+    return ret;
+#else
     if (setjmp(zfalrmbuf)) {
 	alarm(0);
 	zwarnnam("zftp", "timeout on network read");
@@ -1323,6 +1399,7 @@ zfread(int fd, char *bf, off_t sz, int tmout)
     /* we don't bother turning off the whole alarm mechanism here */
     alarm(0);
     return ret;
+#endif
 }
 
 /* Write with timeout if recv is not set. */
@@ -1336,6 +1413,17 @@ zfwrite(int fd, char *bf, off_t sz, int tmout)
     if (!tmout)
 	return write(fd, bf, sz);
 
+#ifdef ZF_POLL
+    do {
+	if (zfwait(fd, POLLOUT, tmout)) {
+	    if (zfdrrrring)
+		zwarnnam("zftp", "timeout on network write");
+	    return -1;
+	}
+    } while ((ret = write(fd, bf, sz)) < 0 &&
+	     (errno == EAGAIN || errno == EWOULDBLOCK));
+    return ret;
+#else
     if (setjmp(zfalrmbuf)) {
 	alarm(0);
 	zwarnnam("zftp", "timeout on network write");
@@ -1348,6 +1436,7 @@ zfwrite(int fd, char *bf, off_t sz, int tmout)
     /* we don't bother turning off the whole alarm mechanism here */
     alarm(0);
     return ret;
+#endif
 }
 
 static int zfread_eof;
@@ -1439,6 +1528,132 @@ zfwrite_block(int fd, char *bf, off_t sz, int tmout)
     return sz;
 }
 
+/*
+ * Ways zfsenddata() can move the data.  Other than ZFMV_COPY these
+ * are only for image type in stream mode, where nothing needs to look
+ * at the bytes on the way through, so the kernel can move them itself.
+ */
+enum {
+    ZFMV_COPY,		/* read() and write() through our buffer */
+    ZFMV_SENDFILE,	/* sendfile() from a local file to the socket */
+    ZFMV_SPLICE,	/* splice() between the socket and a local pipe */
+    ZFMV_PIPE		/* splice() from the socket to a file via pfds */
+};
+
+/*
+ * Decide how to move data between the local fd and the data
+ * connection.  For ZFMV_PIPE a pipe is opened in pfds, which
+ * the caller closes.
+ */
+
+/**/
+static int
+zfmovehow(int fd, int recv, UNUSED(int *pfds), UNUSED(int size))
+{
+    struct stat st;
+
+    if (ZFST_CTYP(zfstatusp[zfsessno]) != ZFST_IMAG ||
+	ZFST_MODE(zfstatusp[zfsessno]) == ZFST_BLOC || fstat(fd, &st))
+	return ZFMV_COPY;
+#ifdef HAVE_SENDFILE
+    if (!recv && S_ISREG(st.st_mode))
+	return ZFMV_SENDFILE;
+#endif
+#ifdef HAVE_SPLICE
+    if (S_ISFIFO(st.st_mode))
+	return ZFMV_SPLICE;
+    if (recv && S_ISREG(st.st_mode) && !pipe(pfds)) {
+#ifdef F_SETPIPE_SZ
+	fcntl(pfds[1], F_SETPIPE_SZ, size);
+#endif
+	return ZFMV_PIPE;
+    }
+#endif
+    return ZFMV_COPY;
+}
+
+/*
+ * Move up to sz bytes from fdin to fdout the way *howp says.
+ * Returns the number of bytes moved, 0 at the end of the data, or -1
+ * for an error, setting *localp if it was on the local side.
+ * EINVAL or ENOSYS from the first call means the kernel won't do it
+ * for this pair of fds, and the caller should copy instead.
+ *
+ * When emptying the pipe for ZFMV_PIPE, a file that can't be spliced
+ * to (one opened for appending, say) gets what's in the pipe through
+ * bf, of at least sz bytes, and *howp becomes ZFMV_COPY.
+ */
+
+/**/
+static int
+zfmove(int *howp, int fdin, int fdout, int *pfds, char *bf, int sz,
+       int recv, int tmout, int *localp)
+{
+    ssize_t n = -1;
+
+    *localp = 0;
+    for (;;) {
+#ifdef ZF_POLL
+	if (tmout && zfwait(recv ? fdin : fdout, recv ? POLLIN : POLLOUT,
+			    tmout)) {
+	    if (zfdrrrring)
+		zwarnnam("zftp", "timeout on network %s",
+			 recv ? "read" : "write");
+	    return -1;
+	}
+#endif
+	switch (*howp) {
+#ifdef HAVE_SENDFILE
+	case ZFMV_SENDFILE:
+	    n = sendfile(fdout, fdin, NULL, sz);
+	    break;
+#endif
+#ifdef HAVE_SPLICE
+	case ZFMV_SPLICE:
+	    n = splice(fdin, NULL, fdout, NULL, sz,
+		       SPLICE_F_MOVE | (recv ? 0 : SPLICE_F_MORE));
+	    break;
+
+	case ZFMV_PIPE:
+	    n = splice(fdin, NULL, pfds[1], NULL, sz, SPLICE_F_MOVE);
+	    break;
+#endif
+	default:
+	    errno = ENOSYS;
+	    return -1;
+	}
+	if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+	    break;
+    }
+#ifdef HAVE_SPLICE
+    if (*howp == ZFMV_PIPE && n > 0) {
+	ssize_t left = n, ret;
+
+	while (left > 0) {
+	    if (*howp == ZFMV_PIPE) {
+		ret = splice(pfds[0], NULL, fdout, NULL, left, SPLICE_F_MOVE);
+		if (ret < 0 && errno == EINVAL) {
+		    *howp = ZFMV_COPY;
+		    continue;
+		}
+	    } else if ((ret = read(pfds[0], bf, left)) > 0 &&
+		       write_loop(fdout, bf, ret) < 0)
+		ret = -1;
+	    if (ret <= 0) {
+		if (ret < 0 && errno == EINTR && !errflag)
+		    continue;
+		if (!ret)
+		    errno = EIO;
+		*localp = 1;
+		return -1;
+	    }
+	    left -= ret;
+	}
+    }
+#endif
+    return (int)n;
+}
+
 /*
  * Move stuff from fdin to fdout, tidying up the data connection
  * when finished.  The data connection could be either input or output:
@@ -1456,11 +1671,13 @@ static int
 zfsenddata(char *name, int recv, int progress, off_t startat)
 {
 #define ZF_BUFSIZE 32768
-#define ZF_ASCSIZE (ZF_BUFSIZE/2)
+#define ZF_BLKSIZE 65535
+#define ZF_MOVESIZE (256*1024)
     /* ret = 2 signals the local read/write failed, so send abort */
     int n, ret = 0, gotack = 0, fdin, fdout, fromasc = 0, toasc = 0;
-    int rtmout = 0, wtmout = 0;
-    char lsbuf[ZF_BUFSIZE], *ascbuf = NULL, *optr;
+    int rtmout = 0, wtmout = 0, how, moved = 0, pfds[2] = { -1, -1 };
+    int bufsize = (int)getiparam("ZFTP_BUFSIZE"), movesize, ascsize;
+    char *lsbuf, *ascbuf = NULL, *optr;
     off_t sofar = 0, last_sofar = 0;
     readwrite_t read_ptr = zfread, write_ptr = zfwrite;
     Shfunc shfunc;
@@ -1495,16 +1712,65 @@ zfsenddata(char *name, int recv, int progress, off_t startat)
 	    toasc = 1;
 	if (ZFST_MODE(zfstatusp[zfsessno]) == ZFST_BLOC)
 	    write_ptr = zfwrite_block;
+#ifdef ZF_POLL
+	/* see zfwait() */
+	if (wtmout)
+	    fcntl(fdout, F_SETFL, fcntl(fdout, F_GETFL, 0) | O_NONBLOCK);
+#endif
     }
 
+    /*
+     * $ZFTP_BUFSIZE, if set, gives the size of the chunks we move,
+     * though blocks can't be more than ZF_BLKSIZE bytes either way.
+     * Chunks the kernel moves for us can be bigger by default.
+     */
+    if (bufsize <= 0) {
+	bufsize = ZF_BUFSIZE;
+	movesize = ZF_MOVESIZE;
+    } else {
+	if (bufsize < 512)
+	    bufsize = 512;
+	movesize = bufsize;
+    }
+    if (ZFST_MODE(zfstatusp[zfsessno]) == ZFST_BLOC &&
+	(recv || bufsize > ZF_BLKSIZE))
+	bufsize = ZF_BLKSIZE;
+    ascsize = bufsize / 2;
+    how = zfmovehow(recv ? fdout : fdin, recv, pfds, movesize);
+    if (how == ZFMV_PIPE && bufsize < movesize)
+	bufsize = movesize;	/* for emptying the pipe in zfmove() */
+    lsbuf = zalloc(bufsize);
     if (toasc)
-	ascbuf = zalloc(ZF_ASCSIZE);
+	ascbuf = zalloc(ascsize);
     zfpipe();
     zfread_eof = 0;
     while (!ret && !zfread_eof) {
-	n = (toasc) ? read_ptr(fdin, ascbuf, ZF_ASCSIZE, rtmout)
-	    : read_ptr(fdin, lsbuf, ZF_BUFSIZE, rtmout);
-	if (n > 0) {
+	if (how != ZFMV_COPY) {
+	    int local;
+
+	    n = zfmove(&how, fdin, fdout, pfds, lsbuf, movesize, recv,
+		       recv ? rtmout : wtmout, &local);
+	    if (n < 0 && !moved && (errno == EINVAL || errno == ENOSYS)) {
+		how = ZFMV_COPY;
+		continue;
+	    } else if (n < 0) {
+		/* see below for what this is about */
+		if (errno != EINTR || errflag || zfdrrrring) {
+		    if (!zfdrrrring &&
+			(!interact || (!errflag && errno != EPIPE))) {
+			ret = local ? 2 : 1;
+			zwarnnam(name, "transfer failed: %e", errno);
+		    } else
+			ret = local ? 3 : 1;
+		    break;
+		}
+		continue;
+	    } else if (!n)
+		break;
+	    moved = 1;
+	    sofar += n;
+	} else if ((n = (toasc) ? read_ptr(fdin, ascbuf, ascsize, rtmout)
+		    : read_ptr(fdin, lsbuf, bufsize, rtmout)) > 0) {
 	    char *iptr;
 	    if (toasc) {
 		/* \n -> \r\n it shouldn't happen to a dog. */
@@ -1676,7 +1942,12 @@ zfsenddata(char *name, int recv, int progress, off_t startat)
     }
 	
     if (toasc)
-	zfree(ascbuf, ZF_ASCSIZE);
+	zfree(ascbuf, ascsize);
+    zfree(lsbuf, bufsize);
+    if (pfds[0] >= 0) {
+	close(pfds[0]);
+	close(pfds[1]);
+    }
     zfclosedata();
     if (!gotack && zfgetmsg() > 2)
 	ret = 1;
@@ -1993,7 +1993,237 @@ bin_zparseopts(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
     return 0;
 }
 
+/*
+ * zbatch: run a command on successive batches of arguments, for zargs.
+ * The batches are those zargs has always made: as many as -l allows,
+ * halved until they fit within -s characters, then cut to -n.  With
+ * a -P other than 1 each batch is run in the background and the next
+ * one started as soon as any of the -P running ones finishes.
+ */
+
+#define ZBATCH_MAXCHARS 20480
+
+/* Length of args[from] to args[to - 1] joined by spaces, from cum. */
+#define zbatch_len(cum, from, to) ((cum)[to] - (cum)[from] - 1)
+
+/*
+ * Fold the status of a batch into *ret as zargs reports it: 123 if
+ * any batch failed, or the code for a batch that must stop zargs,
+ * in which case return 1.
+ */
+
+static int
+zbatch_status(int st, int *ret)
+{
+    int r;
+
+    if (!st)
+	return 0;
+    if (st <= 125 || st == 128) {
+	if (!*ret)
+	    *ret = 123;
+	return 0;
+    }
+    if (st == 255)
+	r = 124;
+    else if (st >= 129 && st <= 254)
+	r = 125;
+    else if (st == 126 || st == 127)
+	r = st;
+    else
+	r = 1;
+    if (!*ret || *ret == 123)
+	*ret = r;
+    return 1;
+}
+
+/* Parse the numeric argument of an option, which must be at least min. */
+
+static int
+zbatch_opt(char *nam, Options ops, int c, zlong min, zlong *val)
+{
+    char *s = OPT_ARG_SAFE(ops, c), *e;
+
+    if (!s)
+	return 0;
+    *val = zstrtol(s, &e, 10);
+    if (*e || *val < min) {
+	zwarnnam(nam, "invalid number for -%c: %s", c, s);
+	return 1;
+    }
+    return 0;
+}
+
+static int
+bin_zbatch(char *nam, char **args, Options ops, UNUSED(int func))
+{
+    char **cmd, **call, **cp, **sp, *str, *rep = NULL, *p;
+    zlong maxargs, maxchars = ZBATCH_MAXCHARS, maxlines, maxprocs = 1;
+    zlong *cum, cmdlen = 0, len;
+    int nargs, ncmd, pos, end, i, bg, nrun = 0, nbatch = 0, ret = 0;
+    int st, stop = 0, *stats = NULL, *runidx;
+    pid_t *pids;
+    Eprog prog;
+
+    if (!(cmd = getaparam(*args)) || !*cmd) {
+	zwarnnam(nam, "%s: no command given", *args);
+	return 1;
+    }
+    ncmd = arrlen(cmd);
+    args++;
+    nargs = arrlen(args);
+    maxargs = maxlines = nargs ? nargs : 1;
+    if (zbatch_opt(nam, ops, 'n', 1, &maxargs) ||
+	zbatch_opt(nam, ops, 's', 1, &maxchars) ||
+	zbatch_opt(nam, ops, 'l', 1, &maxlines) ||
+	zbatch_opt(nam, ops, 'P', 0, &maxprocs))
+	return 1;
+    if (OPT_ISSET(ops, 'I'))
+	rep = OPT_ARG(ops, 'I');
+    if (!nargs)
+	return 0;
+
+    /* cum[i] is the length of the first i arguments each with a space */
+    cum = (zlong *) zhalloc((nargs + 1) * sizeof(zlong));
+    cum[0] = 0;
+    for (i = 0; i < nargs; i++)
+	cum[i + 1] = cum[i] + MB_METASTRLEN(args[i]) + 1;
+    for (cp = cmd; *cp; cp++)
+	cmdlen += MB_METASTRLEN(*cp) + 1;
+
+    bg = maxprocs != 1 && nargs > 1;
+    if (!maxprocs || maxprocs > nargs)
+	maxprocs = nargs;
+    pids = (pid_t *) zhalloc(maxprocs * sizeof(pid_t));
+    runidx = (int *) zhalloc(maxprocs * sizeof(int));
+    if (OPT_ISSET(ops, 'a')) {
+	stats = (int *) zhalloc(nargs * sizeof(int));
+	for (i = 0; i < nargs; i++)
+	    stats[i] = -1;
+    }
+
+    for (pos = 0; pos < nargs && !stop && !errflag; pos += end) {
+	for (end = maxlines > nargs - pos ? nargs - pos : maxlines;
+	     end > 1 && zbatch_len(cum, pos, pos + end) > maxchars;
+	     end /= 2)
+	    ;
+	if (end > maxargs)
+	    end = maxargs;
+
+	pushheap();
+	if (rep) {
+	    call = (char **) zhalloc((end + 1) * sizeof(char *));
+	    memcpy(call, args + pos, end * sizeof(char *));
+	    call[end] = NULL;
+	    str = zjoin(call, ' ', 1);
+	    call = (char **) zhalloc((ncmd + 1) * sizeof(char *));
+	    for (cp = cmd, sp = call; *cp; cp++, sp++) {
+		for (p = *cp; *p && !strpfx(rep, p); p += (*p == Meta) ? 2 : 1)
+		    ;
+		if (*p || !*rep) {
+		    *sp = zhalloc(strlen(*cp) + strlen(str) + 1);
+		    sprintf(*sp, "%.*s%s%s", (int) (p - *cp), *cp, str,
+			    p + strlen(rep));
+		} else
+		    *sp = *cp;
+	    }
+	    *sp = NULL;
+	    len = -1;
+	    for (sp = call; *sp; sp++)
+		len += MB_METASTRLEN(*sp) + 1;
+	} else {
+	    call = (char **) zhalloc((ncmd + end + 1) * sizeof(char *));
+	    memcpy(call, cmd, ncmd * sizeof(char *));
+	    memcpy(call + ncmd, args + pos, end * sizeof(char *));
+	    call[ncmd + end] = NULL;
+	    len = cmdlen + zbatch_len(cum, pos, pos + end);
+	}
+	if (len > maxchars) {
+	    popheap();
+	    zwarnnam(nam, "cannot fit single argument within size limit");
+	    if (OPT_ISSET(ops, 'x')) {
+		ret = 1;
+		stop = 1;
+	    }
+	    continue;
+	}
+
+	if (bg && nrun == maxprocs) {
+	    if ((i = waitforanypid(pids, nrun, &st)) < 0) {
+		popheap();
+		break;
+	    }
+	    if (stats)
+		stats[runidx[i]] = st;
+	    pids[i] = pids[--nrun];
+	    runidx[i] = runidx[nrun];
+	    if (zbatch_status(st, &ret)) {
+		popheap();
+		break;
+	    }
+	}
+
+	if (OPT_ISSET(ops, 't')) {
+	    for (sp = call; *sp; sp++) {
+		if (sp != call)
+		    fputc(' ', stderr);
+		fputs(unmeta(*sp), stderr);
+	    }
+	    fputc('\n', stderr);
+	    fflush(stderr);
+	}
+	/*
+	 * Quote every word so that, as when zargs ran "${(@)call}",
+	 * none is taken as an alias, reserved word or assignment.
+	 */
+	for (sp = call; *sp; sp++)
+	    *sp = zhtricat("'", quotestring(*sp, QT_SINGLE), "'");
+	str = zjoin(call, ' ', 1);
+	if (bg)
+	    str = dyncat(str, " &");
+	if ((prog = parse_string(str, 0))) {
+	    execode(prog, 1, 0, "zbatch");
+	    st = lastval;
+	} else
+	    st = 1;
+	if (bg && prog) {
+	    pids[nrun] = (pid_t) lastpid;
+	    runidx[nrun++] = nbatch;
+	} else {
+	    if (stats)
+		stats[nbatch] = st;
+	    stop = zbatch_status(st, &ret);
+	}
+	nbatch++;
+	popheap();
+    }
+    while (nrun && (i = waitforanypid(pids, nrun, &st)) >= 0) {
+	if (stats)
+	    stats[runidx[i]] = st;
+	pids[i] = pids[--nrun];
+	runidx[i] = runidx[nrun];
+	zbatch_status(st, &ret);
+    }
+
+    if (stats) {
+	char **arr = (char **) zalloc((nbatch + 1) * sizeof(char *));
+	char buf[DIGBUFSIZE];
+
+	for (i = 0; i < nbatch; i++) {
+	    if (stats[i] < 0)
+		*buf = '\0';
+	    else
+		sprintf(buf, "%d", stats[i]);
+	    arr[i] = ztrdup(buf);
+	}
+	arr[i] = NULL;
+	setaparam(OPT_ARG(ops, 'a'), arr);
+    }
+    return errflag ? 1 : ret;
+}
+
 static struct builtin bintab[] = {
+    BUILTIN("zbatch", 0, bin_zbatch, 1, -1, 0, "a:I:l:n:P:s:tx", NULL),
     BUILTIN("zformat", 0, bin_zformat, 3, -1, 0, NULL, NULL),
     BUILTIN("zparseopts", 0, bin_zparseopts, 1, -1, 0, NULL, NULL),
     BUILTIN("zregexparse", 0, bin_zregexparse, 3, -1, 0, "c", NULL),
@@ -4894,6 +4894,233 @@ cf_remove_other(char **names, char *pre, int *amb)
     return NULL;
 }
 
+/*
+ * The contents of directories read by compfiles -g, kept so that
+ * completing the same path again doesn't read every directory on the
+ * way once more.  An entry is used as long as the directory's stat
+ * information is unchanged and it wasn't last modified in or after
+ * the second it was read in.  The names are kept in the order the
+ * globbing code would sort them in.
+ */
+
+struct cfdir {
+    char *path;			/* the directory as given, metafied */
+    struct stat st;
+    time_t read;		/* when the contents were read */
+    char **names;		/* entries without . and .., metafied, sorted */
+    mode_t *modes;		/* lstat() modes, 0 if not yet known */
+    int nnames;
+    int numsort;		/* names sorted for NUMERIC_GLOB_SORT */
+    long used;			/* for replacing the least recently used */
+};
+
+#define MAX_CFDIRS 16
+static struct cfdir cfdirs[MAX_CFDIRS];
+static long cfdirclock;
+
+static void
+freecfdir(struct cfdir *d)
+{
+    if (d->path) {
+	zsfree(d->path);
+	freearray(d->names);
+	zfree(d->modes, d->nnames * sizeof(mode_t));
+	d->path = NULL;
+    }
+}
+
+static struct cfdir *
+cf_getdir(char *path)
+{
+    struct cfdir *d, *e = cfdirs + MAX_CFDIRS;
+    struct stat st;
+    DIR *dir;
+    LinkList l;
+    char *fn;
+
+    if (stat(unmeta(*path ? path : "."), &st) || !S_ISDIR(st.st_mode))
+	return NULL;
+    for (d = cfdirs; d < e; d++)
+	if (d->path && !strcmp(d->path, path))
+	    break;
+    if (d < e) {
+	if (st.st_dev == d->st.st_dev && st.st_ino == d->st.st_ino &&
+	    st.st_mtime == d->st.st_mtime && st.st_mtime < d->read &&
+	    d->numsort == isset(NUMERICGLOBSORT)
+#ifdef GET_ST_MTIME_NSEC
+	    && GET_ST_MTIME_NSEC(st) == GET_ST_MTIME_NSEC(d->st)
+#endif
+	    ) {
+	    d->used = ++cfdirclock;
+	    return d;
+	}
+    } else {
+	struct cfdir *o;
+
+	for (d = o = cfdirs; o < e; o++)
+	    if (!o->path || o->used < d->used) {
+		d = o;
+		if (!o->path)
+		    break;
+	    }
+    }
+    freecfdir(d);
+    if (!(dir = opendir(unmeta(*path ? path : "."))))
+	return NULL;
+    d->read = time(NULL);
+    for (l = newlinklist(); (fn = zreaddir(dir, 1)); )
+	addlinknode(l, dupstring(fn));
+    closedir(dir);
+
+    d->path = ztrdup(path);
+    d->st = st;
+    d->nnames = countlinknodes(l);
+    d->names = zlinklist2array(l);
+    d->numsort = isset(NUMERICGLOBSORT);
+    strmetasort(d->names, d->numsort ? SORTIT_NUMERICALLY : 0, NULL);
+    d->modes = (mode_t *) zshcalloc(d->nnames * sizeof(mode_t));
+    d->used = ++cfdirclock;
+
+    return d;
+}
+
+/* Test if the i'th entry of d, with the full name given, is a directory. */
+
+static int
+cf_isdir(struct cfdir *d, int i, char *name)
+{
+    struct stat st;
+
+    if (!d->modes[i]) {
+	if (lstat(unmeta(name), &st))
+	    return 0;
+	d->modes[i] = st.st_mode;
+    }
+    if (S_ISLNK(d->modes[i]))
+	return !stat(unmeta(name), &st) && S_ISDIR(st.st_mode);
+
+    return S_ISDIR(d->modes[i]);
+}
+
+/*
+ * Check if a tokenized pattern is one cf_glob() can handle itself: a
+ * literal directory followed by a simple pattern for the last path
+ * component, with either no glob qualifiers or just (-/).  The
+ * patterns built by cf_pats() are nearly always like this.  Returns
+ * the directory, with its trailing slash, and sets *patp and *dirsp.
+ */
+
+static char *
+cf_simplepat(char *str, char **patp, int *dirsp)
+{
+    char *s, *p, *d, *dir;
+    int l;
+
+    if (unset(GLOBOPT) || unset(EXECOPT) || unset(CASEGLOB) ||
+	isset(MARKDIRS) || isset(SHGLOB) || isset(KSHGLOB) ||
+	*str == Equals || !haswilds(str))
+	return NULL;
+    l = strlen(str);
+    if ((*dirsp = (l > 4 && str[l - 4] == Inpar && IS_DASH(str[l - 3]) &&
+		   str[l - 2] == '/' && str[l - 1] == Outpar)))
+	str = dupstrpfx(str, l -= 4);
+    if (!l || str[l - 1] == Outpar || (!isset(BAREGLOBQUAL) && *dirsp))
+	return NULL;
+    if ((s = strrchr(str, '/')))
+	s++;
+    else
+	s = str;
+    for (p = str, d = dir = (char *) zhalloc(s - str + 1); p < s; p++) {
+	if (*p == Meta)
+	    *d++ = *p++;
+	else if (*p == Bnullkeep)
+	    continue;
+	else if (itok(*p))
+	    return NULL;
+	*d++ = *p;
+    }
+    *d = '\0';
+    if (!*s || (s[0] == Star && s[1] == Star))
+	return NULL;
+    for (p = s; *p; p++) {
+	if (*p == Meta)
+	    p++;
+	else if (*p == Tilde || *p == Equals || (*p == Inpar && p[1] == Pound))
+	    return NULL;
+    }
+    *patp = s;
+
+    return dir;
+}
+
+/*
+ * Match the simple pattern pat against the entries of dir and add the
+ * matches to ret, in the order the globbing code would generate them.
+ * Returns non-zero if the pattern has to be expanded by the globbing
+ * code instead.
+ */
+
+static int
+cf_globdir(LinkList ret, char *dir, char *pat, int dirs)
+{
+    Patprog prog;
+    struct cfdir *d;
+    char *n;
+    int i, dl;
+
+    patcompstart();
+    if (!(prog = patcompile(pat, (unset(GLOBDOTS) ?
+				  (PAT_FILE|PAT_FILET|PAT_NOGLD) :
+				  (PAT_FILE|PAT_FILET)), NULL)) ||
+	(prog->flags & PAT_PURES))
+	return 1;
+    if (!(d = cf_getdir(dir)))
+	return 0;
+
+    dl = strlen(dir);
+    for (i = 0; i < d->nnames; i++) {
+	if ((dirs && d->modes[i] && !S_ISDIR(d->modes[i]) &&
+	     !S_ISLNK(d->modes[i])) ||
+	    !pattry(prog, d->names[i]))
+	    continue;
+	n = (char *) zhalloc(dl + strlen(d->names[i]) + 1);
+	strcpy(n, dir);
+	strcpy(n + dl, d->names[i]);
+	if (!dirs || cf_isdir(d, i, n))
+	    addlinknode(ret, n);
+    }
+    return 0;
+}
+
+/*
+ * Expand the patterns in the array like ( $~array ) would.  The simple
+ * ones are matched against the cached directory contents, the others
+ * are handed to the globbing code.
+ */
+
+static LinkList
+cf_glob(char **pats)
+{
+    LinkList ret = newlinklist(), l;
+    char *str, *dir, *pat;
+    int dirs;
+
+    for (; *pats && !errflag; pats++) {
+	shtokenize(str = dupstring(*pats));
+	remnulargs(str);
+	if ((dir = cf_simplepat(str, &pat, &dirs)) &&
+	    !cf_globdir(ret, dir, pat, dirs))
+	    continue;
+	l = newlinklist();
+	addlinknode(l, str);
+	prefork(l, PREFORK_ASSIGN, NULL);
+	if (!errflag)
+	    globlist(l, 0);
+	joinlists(ret, l);
+    }
+    return ret;
+}
+
 /*
  * SYNOPSIS:
  *     1. compfiles -p  parnam1 parnam2 skipped matcher sdirs parnam3 varargs [..varargs]
@@ -4906,6 +5133,11 @@ cf_remove_other(char **names, char *pre, int *amb)
  *     3. Like #1 but varargs is implicitly set to  char *varargs[2] = { "*(-/)", NULL };.
  *
  *     parnam2 has to do with the accept-exact style (see cfp_test_exact()).
+ *
+ *     4. compfiles -g  parnam1
+ *
+ *     Expand the patterns in ${(P)parnam1} in place, setting the array to
+ *     the filenames ( ${~${(P)parnam1}} ) would give; see cf_glob().
  */
 
 static int
@@ -4949,6 +5181,34 @@ bin_compfiles(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
 	    unqueue_signals();
 	    return 0;
 	}
+    case 'g':
+	if (args[0][2]) {
+	    zwarnnam(nam, "invalid option: %s", *args);
+	    return 1;
+	} else {
+	    char **tmp;
+	    LinkList l;
+
+	    if (!args[1]) {
+		zwarnnam(nam, "too few arguments");
+		return 1;
+	    }
+	    if (args[2]) {
+		zwarnnam(nam, "too many arguments");
+		return 1;
+	    }
+	    queue_signals();
+	    if (!(tmp = getaparam(args[1]))) {
+		unqueue_signals();
+		zwarnnam(nam, "unknown parameter: %s", args[1]);
+		return 0;
+	    }
+	    l = cf_glob(tmp);
+	    if (!errflag)
+		set_list_array(args[1], l);
+	    unqueue_signals();
+	    return !!errflag;
+	}
     case 'i':
 	if (args[0][2]) {
 	    zwarnnam(nam, "invalid option: %s", *args);
@@ -5069,6 +5329,7 @@ setup_(UNUSED(Module m))
     memset(cvdef_cache, 0, sizeof(cvdef_cache));
 
     memset(comptags, 0, sizeof(comptags));
+    memset(cfdirs, 0, sizeof(cfdirs));
 
     lasttaglevel = 0;
 
@@ -5118,5 +5379,8 @@ finish_(UNUSED(Module m))
     for (i = 0; i < MAX_TAGS; i++)
 	freectags(comptags[i]);
 
+    for (i = 0; i < MAX_CFDIRS; i++)
+	freecfdir(cfdirs + i);
+
     return 0;
 }
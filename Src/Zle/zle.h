@@ -283,16 +283,19 @@ struct change {
     int flags;			/* see below */
     int hist;			/* history line being changed */
     int off;			/* offset of the text changes */
-    ZLE_STRING_T del;		/* characters to delete */
+    void *del;			/* characters to delete */
     int dell;			/* no. of characters in del */
-    ZLE_STRING_T ins;		/* characters to insert */
+    void *ins;			/* characters to insert */
     int insl;			/* no. of characters in ins */
     int old_cs, new_cs;		/* old and new cursor positions */
     zlong changeno;             /* unique number of this change */
+    int steps;			/* no. of insertions merged into this one */
 };
 
 #define CH_NEXT (1<<0)   /* next structure is also part of this change */
 #define CH_PREV (1<<1)   /* previous structure is also part of this change */
+#define CH_DELBYTES (1<<2) /* del holds one byte per character */
+#define CH_INSBYTES (1<<3) /* ins holds one byte per character */
 
 /* vi change handling for vi-repeat-change */
 
@@ -1280,6 +1280,7 @@ zleread(char **lp, char **rp, int flags, int context, char *init, char *finish)
     statusline = NULL;
     selectkeymap("main", 1);
     initundo();
+    freecompresumes();
     fixsuffix();
     if ((s = getlinknode(bufstack))) {
 	setline(s, ZSL_TOEND);
@@ -2315,6 +2316,7 @@ finish_(UNUSED(Module m))
     zle_load_state = 0;
 
     zfree(clwords, clwsize * sizeof(char *));
+    freecompresumes();
     zle_refresh_finish();
 
     return 0;
@@ -2409,7 +2409,7 @@ tcoutarg(int cap, int arg)
 {
     char *result;
 
-    result = tgoto(tcstr[cap], arg, arg);
+    result = tcgoto(cap, arg);
     if (tcout_func_name) {
 	tcout_via_func(cap, arg, putshout);
     } else {
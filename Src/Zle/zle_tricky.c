@@ -1077,6 +1077,144 @@ has_real_token(const char *s)
 }
 
 
+/*
+ * Points in the line after a separator from which get_comp_string()
+ * can resume lexing when called again, with the state of the lexer and
+ * of get_comp_string() at each point.  These are only recorded where
+ * that state is simple, which is true between most commands at the
+ * top level of the line, so long multi-line buffers needn't be lexed
+ * from the start each time.  The points are kept with the line and
+ * options they were found with, and only used as far as the line is
+ * unchanged.
+ */
+
+struct compresume {
+    int off;			/* offset into zlemetaline */
+    int incmdpos, intypeset, isnewlin, nocorrect, isfirstln, isfirstch;
+    int ins, oins, varq, wordpos, redirpos, cp, rd, ia;
+    enum lextok cmdtok, tt0;
+    char *cmdstr, *varname;
+    char **words;		/* clwords[0] to clwords[wordpos-1] */
+    int nrdstrs;		/* length of rdstrs */
+    char *rdstr;		/* contents of rdstr, if set */
+};
+
+static struct compresume *compresumes;
+static int ncompresumes, compresumesz;
+
+/* rdstrs only grows during lexing, so the points share a copy */
+static char **compresumerdstrs;
+
+static char *compresumeline;
+static char compresumeopts[OPT_SIZE];
+static int compresumenoal;
+static zlong compresumealgen;
+
+/* Forget resume points from the n'th on */
+
+/**/
+static void
+trimcompresumes(int n)
+{
+    struct compresume *cr;
+
+    for (cr = compresumes + n; ncompresumes > n; ncompresumes--, cr++) {
+	zsfree(cr->cmdstr);
+	zsfree(cr->varname);
+	freearray(cr->words);
+	zsfree(cr->rdstr);
+    }
+}
+
+/**/
+void
+freecompresumes(void)
+{
+    trimcompresumes(0);
+    zfree(compresumes, compresumesz * sizeof(*compresumes));
+    compresumes = NULL;
+    compresumesz = 0;
+    if (compresumerdstrs)
+	freearray(compresumerdstrs);
+    compresumerdstrs = NULL;
+    zsfree(compresumeline);
+    compresumeline = NULL;
+}
+
+/*
+ * Find the last resume point that can be used for zlemetaline with the
+ * cursor at zlemetacs, discarding those after it.  The character just
+ * after the point must be unchanged too, as the lexer will have looked
+ * at it.
+ */
+
+/**/
+static struct compresume *
+getcompresume(void)
+{
+    char *p, *q;
+    int n;
+
+    if (!compresumeline || compresumenoal != noaliases ||
+	compresumealgen != getaliasgen() ||
+	memcmp(compresumeopts, opts, OPT_SIZE)) {
+	trimcompresumes(0);
+	return NULL;
+    }
+    for (p = compresumeline, q = zlemetaline; *p && *p == *q; p++, q++)
+	;
+    for (n = ncompresumes; n; n--)
+	if (compresumes[n - 1].off < p - compresumeline &&
+	    compresumes[n - 1].off < zlemetacs)
+	    break;
+    trimcompresumes(n);
+    return n ? compresumes + n - 1 : NULL;
+}
+
+/* Record a resume point at off in zlemetaline */
+
+/**/
+static void
+addcompresume(int off, int ins, int oins, int varq, int wordpos,
+	      int redirpos, int cp, int rd, int ia, enum lextok cmdtok,
+	      enum lextok tt0, char *rdop)
+{
+    struct compresume *cr;
+    int i;
+
+    if (ncompresumes == compresumesz) {
+	compresumesz = compresumesz ? 2 * compresumesz : 64;
+	compresumes = zrealloc(compresumes,
+			       compresumesz * sizeof(*compresumes));
+    }
+    cr = compresumes + ncompresumes++;
+    cr->off = off;
+    cr->incmdpos = incmdpos;
+    cr->intypeset = intypeset;
+    cr->isnewlin = isnewlin;
+    cr->nocorrect = nocorrect;
+    cr->isfirstln = isfirstln;
+    cr->isfirstch = isfirstch;
+    cr->ins = ins;
+    cr->oins = oins;
+    cr->varq = varq;
+    cr->wordpos = wordpos;
+    cr->redirpos = redirpos;
+    cr->cp = cp;
+    cr->rd = rd;
+    cr->ia = ia;
+    cr->cmdtok = cmdtok;
+    cr->tt0 = tt0;
+    cr->cmdstr = ztrdup(cmdstr);
+    cr->varname = ztrdup(varname);
+    cr->words = (char **)zalloc((wordpos + 1) * sizeof(char *));
+    for (i = 0; i < wordpos; i++)
+	cr->words[i] = ztrdup(clwords[i]);
+    cr->words[wordpos] = NULL;
+    cr->nrdstrs = countlinknodes(rdstrs);
+    cr->rdstr = ztrdup(rdop);
+}
+
 /* Lasciate ogni speranza.                                                  *
  * This function is a nightmare.  It works, but I'm sure that nobody really *
  * understands why.  The problem is: to make it cleaner we would need       *
@@ -1113,6 +1251,12 @@ get_comp_string(void)
     int noword;
     char *s = NULL, *tmp, *p, *tt = NULL, rdop[20];
     char *linptr, *u;
+    /*
+     * Where lexing started in zlemetaline, the length of the input,
+     * and whether to record resume points.
+     */
+    struct compresume *cr;
+    int lexoff, lexlen, record;
 
     METACHECK();
 
@@ -1168,11 +1312,56 @@ get_comp_string(void)
     clwpos = -1;
     zcontext_save();
     lexflags = LEXFLAGS_ZLE;
-    inpush(dupstrspace(linptr), 0, NULL);
+    /* Resume points are only for the line itself, not substitutions */
+    if ((record = (linptr == zlemetaline)))
+	cr = getcompresume();
+    else
+	cr = NULL;
+    lexoff = cr ? cr->off : 0;
+    u = dupstrspace(linptr + lexoff);
+    lexlen = strlen(u);
+    inpush(u, 0, NULL);
     strinbeg(0);
     wordpos = cp = rd = ins = oins = linarr = parct = ia = redirpos = 0;
     we = wb = zlemetacs;
     tt0 = NULLTOK;
+    if (cr) {
+	incmdpos = cr->incmdpos;
+	intypeset = cr->intypeset;
+	isnewlin = cr->isnewlin;
+	nocorrect = cr->nocorrect;
+	isfirstln = cr->isfirstln;
+	isfirstch = cr->isfirstch;
+	tok = SEPER;
+	ins = cr->ins;
+	oins = cr->oins;
+	varq = cr->varq;
+	wordpos = cr->wordpos;
+	redirpos = cr->redirpos;
+	cp = cr->cp;
+	rd = cr->rd;
+	ia = cr->ia;
+	cmdtok = cr->cmdtok;
+	tt0 = cr->tt0;
+	cmdstr = ztrdup(cr->cmdstr);
+	varname = ztrdup(cr->varname);
+	while (clwsize <= wordpos + 1) {
+	    clwords = (char **)realloc(clwords,
+				       2 * clwsize * sizeof(char *));
+	    memset(clwords + clwsize, 0, clwsize * sizeof(char *));
+	    clwsize *= 2;
+	}
+	for (i = 0; i < wordpos; i++) {
+	    zsfree(clwords[i]);
+	    clwords[i] = ztrdup(cr->words[i]);
+	}
+	for (i = 0; i < cr->nrdstrs; i++)
+	    zaddlinknode(rdstrs, ztrdup(compresumerdstrs[i]));
+	if (cr->rdstr) {
+	    strcpy(rdop, cr->rdstr);
+	    rdstr = strcpy(rdstrbuf, rdop);
+	}
+    }
 
     /* This loop is possibly the wrong way to do this.  It goes through *
      * the previously massaged command line using the lexer.  It stores *
@@ -1185,6 +1374,22 @@ get_comp_string(void)
     do {
         qsub = noword = 0;
 
+	/*
+	 * Between commands at the top level, note where we could
+	 * start next time.
+	 */
+	if (record && tok == SEPER && lexflags && tt0 == NULLTOK &&
+	    clwpos == -1 && inwhat == IN_NOTHING && !insubscr &&
+	    parbegin == -1 && !incond && !inredir && !incasepat &&
+	    !infor && !inrepeat_ && !hdocs && !inalmore &&
+	    !lexstop && !(inbufflags & (INP_ALIAS|INP_CONT)) &&
+	    !linarr && !parct &&
+	    (!ncompresumes ||
+	     compresumes[ncompresumes - 1].off < lexoff + lexlen - inbufct))
+	    addcompresume(lexoff + lexlen - inbufct, ins, oins, varq,
+			  wordpos, redirpos, cp, rd, ia, cmdtok, tt0,
+			  rdop[0] && rdstr ? rdop : NULL);
+
 	/*
 	 * pws: added cmdtok == NULLTOK test as fallback for detecting
 	 * we haven't had a command yet.  This is a cop out: it's needed
@@ -1251,7 +1456,11 @@ get_comp_string(void)
 	    /* Record if we haven't had the command word yet */
 	    if (wordpos == redirpos)
 		redirpos++;
-	    if (zlemetacs < (zlemetall - inbufct) &&
+	    /*
+	     * Not once we've had the word the cursor is on: a later
+	     * redirection in the same command doesn't contain it.
+	     */
+	    if (tt0 == NULLTOK && zlemetacs < (zlemetall - inbufct) &&
 		zlemetacs >= wordbeg && wb == we) {
 		/* Cursor is in the middle of a redirection, treat as a word */
 		we = zlemetall - (inbufct + addedx);
@@ -1443,6 +1652,16 @@ get_comp_string(void)
 	}
     } while (tok != LEXERR && tok != ENDINPUT &&
 	     (tok != SEPER || (lexflags && tt0 == NULLTOK)));
+    if (record) {
+	if (compresumerdstrs)
+	    freearray(compresumerdstrs);
+	compresumerdstrs = zlinklist2array(rdstrs);
+	zsfree(compresumeline);
+	compresumeline = ztrdup(zlemetaline);
+	memcpy(compresumeopts, opts, OPT_SIZE);
+	compresumenoal = noaliases;
+	compresumealgen = getaliasgen();
+    }
     /* Calculate the number of words stored in the clwords array. */
     clwnum = (tt || !wordpos) ? wordpos : wordpos - 1;
     zsfree(clwords[clwnum]);
@@ -2787,6 +3006,31 @@ listlist(LinkList l)
     return !num;
 }
 
+/*
+ * Check whether history expansion could change the line: that needs
+ * a bangchar somewhere, or a hatchar at the start.
+ */
+
+/**/
+static int
+linehashist(void)
+{
+    int i;
+
+    if (STOUC(bangchar) >= 0x80 || STOUC(hatchar) >= 0x80)
+	return 1;
+    for (i = 0; i < zlell && zleline[i] == ZWC(' '); i++)
+	;
+    if (hatchar && i < zlell && zleline[i] == (ZLE_CHAR_T)hatchar)
+	return 1;
+    if (bangchar) {
+	for (i = 0; i < zlell; i++)
+	    if (zleline[i] == (ZLE_CHAR_T)bangchar)
+		return 1;
+    }
+    return 0;
+}
+
 /* Expand the history references. */
 
 /**/
@@ -2798,6 +3042,10 @@ doexpandhist(void)
 
     UNMETACHECK();
 
+    /* Don't lex the whole line if there's nothing to expand */
+    if (!linehashist())
+	return 0;
+
     pushheap();
     metafy_line();
     zle_save_positions();
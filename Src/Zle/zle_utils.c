@@ -1414,16 +1414,35 @@ zlong undo_changeno;
 
 static zlong undo_limitno;
 
+/* memory used by the undo list, and the most it may use (0 for no limit) */
+
+static size_t undo_size, undo_maxsize;
+
+/*
+ * Text at least this long in an undo entry is stored a byte per
+ * character when that loses nothing.
+ */
+
+#define UNDO_PACK_MIN 16
+
 /**/
 void
 initundo(void)
 {
+    zlong maxkb = getiparam("ZLE_UNDO_SIZE");
+
+    if (!maxkb)
+	maxkb = 1024;
+    undo_maxsize = maxkb > 0 ? (size_t)maxkb * 1024 : 0;
     nextchanges = NULL;
     changes = curchange = zalloc(sizeof(*curchange));
     curchange->prev = curchange->next = NULL;
     curchange->del = curchange->ins = NULL;
     curchange->dell = curchange->insl = 0;
+    curchange->flags = 0;
+    curchange->steps = 1;
     curchange->changeno = undo_changeno = undo_limitno = 0;
+    undo_size = changesize(curchange);
     lastline = zalloc((lastlinesz = linesz) * ZLE_CHAR_SIZE);
     ZS_memcpy(lastline, zleline, (lastll = zlell));
     lastcs = zlecs;
@@ -1440,6 +1459,17 @@ freeundo(void)
     lastlinesz = 0;
 }
 
+/* memory used by an undo entry */
+
+/**/
+static size_t
+changesize(struct change *ch)
+{
+    return sizeof(*ch) +
+	ch->dell * ((ch->flags & CH_DELBYTES) ? 1 : ZLE_CHAR_SIZE) +
+	ch->insl * ((ch->flags & CH_INSBYTES) ? 1 : ZLE_CHAR_SIZE);
+}
+
 /**/
 static void
 freechanges(struct change *p)
@@ -1448,12 +1478,158 @@ freechanges(struct change *p)
 
     for(; p; p = n) {
 	n = p->next;
+	undo_size -= changesize(p);
 	free(p->del);
 	free(p->ins);
 	zfree(p, sizeof(*p));
     }
 }
 
+/*
+ * Copy len characters from s for an undo entry.  If they are long
+ * enough to be worth it and all fit in a byte they are stored that
+ * way and flag is set in *flagsp.
+ */
+
+/**/
+static void *
+packchars(ZLE_STRING_T s, int len, int *flagsp, int flag)
+{
+    void *ret;
+#ifdef MULTIBYTE_SUPPORT
+    int i;
+
+    if (len >= UNDO_PACK_MIN) {
+	for (i = 0; i < len && (unsigned long)s[i] < 0x100; i++)
+	    ;
+	if (i == len) {
+	    unsigned char *b = (unsigned char *)zalloc(len);
+
+	    for (i = 0; i < len; i++)
+		b[i] = (unsigned char)s[i];
+	    *flagsp |= flag;
+	    return b;
+	}
+    }
+#endif
+    ret = zalloc(len * ZLE_CHAR_SIZE);
+    ZS_memcpy((ZLE_STRING_T)ret, s, len);
+    return ret;
+}
+
+/* insert len characters from an undo entry at the cursor */
+
+/**/
+static void
+unpackchars(void *p, int len, int bytes)
+{
+    spaceinline(len);
+#ifdef MULTIBYTE_SUPPORT
+    if (bytes) {
+	unsigned char *b = (unsigned char *)p;
+	ZLE_STRING_T s = zleline + zlecs;
+	int i;
+
+	for (i = 0; i < len; i++)
+	    s[i] = (ZLE_CHAR_T)b[i];
+    } else
+#endif
+	ZS_memcpy(zleline + zlecs, (ZLE_STRING_T)p, len);
+    zlecs += len;
+}
+
+/*
+ * Add the change ch, a single character typed, to the change p just
+ * before it if that consists of characters typed the same way.  This
+ * saves an entry per keystroke; the characters are still undone one
+ * at a time, see splitchange().  Returns 1 if ch was merged and freed.
+ */
+
+/**/
+static int
+mergeinsert(struct change *p, struct change *ch)
+{
+    void *ins;
+
+    /* vi mode groups its own changes, see mergeundo() */
+    if (!p || vistartchange >= 0 || p->flags || ch->flags ||
+	p->hist != ch->hist || p->dell || ch->dell ||
+	ch->insl != 1 || p->insl != p->steps ||
+	p->old_cs != p->off || p->new_cs != ch->off ||
+	ch->off != p->off + p->insl || ch->old_cs != ch->off ||
+	ch->new_cs != ch->off + 1 || ch->changeno != p->changeno + 1)
+	return 0;
+    ins = realloc(p->ins, (p->insl + 1) * ZLE_CHAR_SIZE);
+    if (!ins)
+	return 0;
+    ((ZLE_STRING_T)ins)[p->insl++] = *(ZLE_STRING_T)ch->ins;
+    p->ins = ins;
+    p->new_cs = ch->new_cs;
+    p->changeno = ch->changeno;
+    p->steps++;
+    undo_size += ZLE_CHAR_SIZE;
+    ch->next = NULL;
+    freechanges(ch);
+    return 1;
+}
+
+/*
+ * Split the last character typed from a change made by mergeinsert(),
+ * returning the new entry for it, which follows ch.
+ */
+
+/**/
+static struct change *
+splitchange(struct change *ch)
+{
+    struct change *n = zalloc(sizeof(*n));
+
+    n->prev = ch;
+    if ((n->next = ch->next))
+	n->next->prev = n;
+    ch->next = n;
+    n->flags = 0;
+    n->hist = ch->hist;
+    n->off = ch->off + --ch->insl;
+    n->del = NULL;
+    n->dell = 0;
+    n->ins = zalloc(ZLE_CHAR_SIZE);
+    *(ZLE_STRING_T)n->ins = ((ZLE_STRING_T)ch->ins)[ch->insl];
+    n->insl = n->steps = 1;
+    n->old_cs = ch->new_cs = n->off;
+    n->new_cs = n->off + 1;
+    n->changeno = ch->changeno--;
+    ch->steps--;
+    undo_size += sizeof(*n);
+    return n;
+}
+
+/*
+ * Discard the oldest changes while the undo list uses more memory
+ * than allowed, keeping at least the latest change.
+ */
+
+/**/
+static void
+trimundo(void)
+{
+    struct change *p;
+
+    while (undo_maxsize && undo_size > undo_maxsize) {
+	for (p = changes; p != curchange && (p->flags & CH_NEXT);
+	     p = p->next)
+	    ;
+	if (p == curchange || p->next == curchange)
+	    break;
+	p = p->next;
+	p->prev->next = NULL;
+	freechanges(changes);
+	changes = p;
+	p->prev = NULL;
+	p->flags &= ~CH_PREV;
+    }
+}
+
 /* register pending changes in the undo system */
 
 /**/
@@ -1479,19 +1655,27 @@ handleundo(void)
 	if(curchange->next) {
 	    freechanges(curchange->next);
 	    curchange->next = NULL;
+	    undo_size -= changesize(curchange);
 	    free(curchange->del);
 	    free(curchange->ins);
 	    curchange->del = curchange->ins = NULL;
 	    curchange->dell = curchange->insl = 0;
+	    curchange->flags &= ~(CH_DELBYTES|CH_INSBYTES);
+	    curchange->steps = 1;
+	    undo_size += changesize(curchange);
+	}
+	if (nextchanges != endnextchanges ||
+	    !mergeinsert(curchange->prev, nextchanges)) {
+	    nextchanges->prev = curchange->prev;
+	    if(curchange->prev)
+		curchange->prev->next = nextchanges;
+	    else
+		changes = nextchanges;
+	    curchange->prev = endnextchanges;
+	    endnextchanges->next = curchange;
 	}
-	nextchanges->prev = curchange->prev;
-	if(curchange->prev)
-	    curchange->prev->next = nextchanges;
-	else
-	    changes = nextchanges;
-	curchange->prev = endnextchanges;
-	endnextchanges->next = curchange;
 	nextchanges = endnextchanges = NULL;
+	trimundo();
     }
 
     if (remetafy)
@@ -1520,6 +1704,8 @@ mkundoent(void)
 	suf++;
     ch = zalloc(sizeof(*ch));
     ch->next = NULL;
+    ch->flags = 0;
+    ch->steps = 1;
     ch->hist = histline;
     ch->off = pre;
     ch->old_cs = lastcs;
@@ -1529,28 +1715,28 @@ mkundoent(void)
 	ch->dell = 0;
     } else {
 	ch->dell = lastll - pre - suf;
-	ch->del = (ZLE_STRING_T)zalloc(ch->dell * ZLE_CHAR_SIZE);
-	ZS_memcpy(ch->del, lastline + pre, ch->dell);
+	ch->del = packchars(lastline + pre, ch->dell, &ch->flags,
+			    CH_DELBYTES);
     }
     if(suf + pre == zlell) {
 	ch->ins = NULL;
 	ch->insl = 0;
     } else {
 	ch->insl = zlell - pre - suf;
-	ch->ins = (ZLE_STRING_T)zalloc(ch->insl * ZLE_CHAR_SIZE);
-	ZS_memcpy(ch->ins, zleline + pre, ch->insl);
+	ch->ins = packchars(zleline + pre, ch->insl, &ch->flags,
+			    CH_INSBYTES);
     }
     if(nextchanges) {
-	ch->flags = CH_PREV;
+	ch->flags |= CH_PREV;
 	ch->prev = endnextchanges;
 	endnextchanges->flags |= CH_NEXT;
 	endnextchanges->next = ch;
     } else {
 	nextchanges = ch;
-	ch->flags = 0;
 	ch->prev = NULL;
     }
     ch->changeno = ++undo_changeno;
+    undo_size += changesize(ch);
     endnextchanges = ch;
 }
 
@@ -1585,6 +1771,8 @@ undo(char **args)
 	struct change *prev = curchange->prev;
 	if(!prev)
 	    return 1;
+	if (prev->steps > 1)
+	    prev = splitchange(prev);
 	if (prev->changeno <= last_change)
 	    break;
 	if (prev->changeno <= undo_limitno && !*args)
@@ -1618,11 +1806,8 @@ unapplychange(struct change *ch)
     zlecs = ch->off;
     if(ch->ins)
 	foredel(ch->insl, CUT_RAW);
-    if(ch->del) {
-	spaceinline(ch->dell);
-	ZS_memcpy(zleline + zlecs, ch->del, ch->dell);
-	zlecs += ch->dell;
-    }
+    if(ch->del)
+	unpackchars(ch->del, ch->dell, ch->flags & CH_DELBYTES);
     zlecs = ch->old_cs;
     return 1;
 }
@@ -1662,11 +1847,8 @@ applychange(struct change *ch)
     zlecs = ch->off;
     if(ch->del)
 	foredel(ch->dell, CUT_RAW);
-    if(ch->ins) {
-	spaceinline(ch->insl);
-	ZS_memcpy(zleline + zlecs, ch->ins, ch->insl);
-	zlecs += ch->insl;
-    }
+    if(ch->ins)
+	unpackchars(ch->ins, ch->insl, ch->flags & CH_INSBYTES);
     zlecs = ch->new_cs;
     return 1;
 }
@@ -1228,6 +1228,8 @@ cd_new_pwd(int func, LinkNode dir, int quiet)
 	    zsfree(new_pwd);
 	    new_pwd = s;
 	}
+	/* so that paths relative to it needn't be resolved again */
+	addresolveddir(new_pwd, new_pwd);
     }
     if (isset(PUSHDIGNOREDUPS)) {
 	LinkNode n;
@@ -4405,6 +4407,35 @@ mod_export LinkList bufstack;
     else \
 	count += fprintf(fout, spec, width, VAL);
 
+/*
+ * Integer value of a printf argument.  Plain decimal numbers are by
+ * far the commonest case and don't need the arithmetic evaluator.
+ */
+
+static zlong
+printf_intarg(char *s)
+{
+    char *p = s + (*s == '-' || *s == '+');
+    zlong val = 0;
+    int ndigits;
+
+    if (*p >= '1' && *p <= '9') {
+	for (ndigits = 0; ndigits < 18 && *p >= '0' && *p <= '9'; ndigits++)
+	    val = val * 10 + (*p++ - '0');
+	if (!*p)
+	    return (*s == '-') ? -val : val;
+    }
+    return mathevali(s);
+}
+
+/*
+ * The last printf format given and its value after getkeystring(),
+ * as scripts typically use the same format over and over again.
+ */
+
+static char *lastfmtraw, *lastfmt;
+static int lastfmthow, lastfmtlen, lastfmttrunc;
+
 /*
  * Because of the use of getkeystring() to interpret the arguments,
  * the elements of args spend a large part of the function unmetafied
@@ -4538,9 +4569,33 @@ bin_print(char *name, char **args, Options ops, int func)
 	ops->ind['E'] = 1;
     else if (OPT_HASARG(ops,'f'))
 	fmt = OPT_ARG(ops,'f');
-    if (fmt)
-	fmt = getkeystring(fmt, &flen, OPT_ISSET(ops,'b') ? GETKEYS_BINDKEY :
-			   GETKEYS_PRINTF_FMT, &fmttrunc);
+    if (fmt) {
+	int how = OPT_ISSET(ops,'b') ? GETKEYS_BINDKEY : GETKEYS_PRINTF_FMT;
+
+	if (strstr(fmt, "\\u") || strstr(fmt, "\\U")) {
+	    /* depends on the locale, so not worth remembering */
+	    zsfree(lastfmtraw);
+	    lastfmtraw = NULL;
+	    fmt = getkeystring(fmt, &flen, how, &fmttrunc);
+	} else {
+	    if (!lastfmtraw || how != lastfmthow || strcmp(fmt, lastfmtraw)) {
+		zsfree(lastfmtraw);
+		if (lastfmt)
+		    zfree(lastfmt, lastfmtlen + 1);
+		lastfmtraw = ztrdup(fmt);
+		lastfmthow = how;
+		lastfmttrunc = 0;
+		fmt = getkeystring(fmt, &lastfmtlen, how, &lastfmttrunc);
+		lastfmt = zalloc(lastfmtlen + 1);
+		memcpy(lastfmt, fmt, lastfmtlen + 1);
+	    }
+	    /* copied, as directives are temporarily terminated for messages */
+	    fmt = zhalloc(lastfmtlen + 1);
+	    memcpy(fmt, lastfmt, lastfmtlen + 1);
+	    flen = lastfmtlen;
+	    fmttrunc = lastfmttrunc;
+	}
+    }
 
     first = args;
 
@@ -5009,8 +5064,12 @@ bin_print(char *name, char **args, Options ops, int func)
 	}
 	for (c = fmt; c-fmt < flen; c++) {
 	    if (*c != '%') {
-		putc(*c, fout);
-		++count;
+		/* output literal text up to the next directive in one go */
+		char *pct = memchr(c, '%', flen - (c - fmt));
+		size_t lit = (pct ? pct : fmt + flen) - c;
+
+		count += fwrite(c, 1, lit, fout);
+		c += lit - 1;
 		continue;
 	    }
 
@@ -5084,7 +5143,7 @@ bin_print(char *name, char **args, Options ops, int func)
 		    }
 		}
 		if (*argp) {
-		    width = (int)mathevali(*argp++);
+		    width = (int)printf_intarg(*argp++);
 		    if (errflag) {
 			errflag &= ~ERRFLAG_ERROR;
 			ret = 1;
@@ -5118,7 +5177,7 @@ bin_print(char *name, char **args, Options ops, int func)
 		    }
 
 		    if (*argp) {
-			prec = (int)mathevali(*argp++);
+			prec = (int)printf_intarg(*argp++);
 			if (errflag) {
 			    errflag &= ~ERRFLAG_ERROR;
 			    ret = 1;
@@ -5301,7 +5360,7 @@ bin_print(char *name, char **args, Options ops, int func)
  		    	*d++ = 'l';
 #endif
 		    	*d++ = 'l', *d++ = *c, *d = '\0';
-			zlongval = (curarg) ? mathevali(curarg) : 0;
+			zlongval = (curarg) ? printf_intarg(curarg) : 0;
 			if (errflag) {
 			    zlongval = 0;
 			    errflag &= ~ERRFLAG_ERROR;
@@ -7109,6 +7168,7 @@ bin_test(char *name, char **argv, UNUSED(Options ops), int func)
     state.pc = prog->prog;
     state.strs = prog->strs;
 
+    resetcondstat();
     ret = evalcond(&state, name);
     if (ret < 2 && sense)
 	ret = ! ret;
@@ -711,25 +711,30 @@ strtoul(nptr, endptr, base)
 
 /**/
 #ifdef ENABLE_UNICODE9
-#include "./wcwidth9.h"
+/*
+ * Generated at build time from the intervals in wcwidth9.h, so
+ * looking up a width is two array accesses instead of a series of
+ * binary searches.
+ */
+#include "wcwidth9tab.h"
 
 /**/
-int
+mod_export int
 u9_wcwidth(wchar_t ucs)
 {
-  int w = wcwidth9(ucs);
-  if (w < -1)
-    return 1;
-  return w;
+    if ((unsigned long)ucs > WCWIDTH9_MAX)
+	return -1;
+    return wcwidth9_stage2[wcwidth9_stage1[ucs >> WCWIDTH9_PAGE_SHIFT]]
+	[ucs & WCWIDTH9_PAGE_MASK];
 }
 
 /**/
-int
+mod_export int
 u9_iswprint(wint_t ucs)
 {
     if (ucs == 0)
 	return 0;
-    return wcwidth9(ucs) != -1;
+    return u9_wcwidth(ucs) != -1;
 }
 
 /**/
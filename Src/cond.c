@@ -445,12 +445,72 @@ doaccess(char *s, int c)
 }
 
 
+/*
+ * Results of stat() and lstat() for the last few paths tested.  A
+ * condition such as [[ -f $f && -s $f && $f -nt $g ]] only looks at
+ * each file once.  The cache is only valid for a single evaluation:
+ * it is reset by resetcondstat() when a condition is started and
+ * whenever a command is run or the shell forks, since either may
+ * change the file system under our feet.
+ */
+
+#define CONDSTAT_SIZE 4
+
+struct condstat {
+    char *name;			/* unmetafied path, NULL if unused */
+    int flags;			/* CSF_* below */
+    struct stat st;		/* result of stat() */
+    struct stat lst;		/* result of lstat() */
+};
+
+#define CSF_STAT	0x01	/* stat() has been tried */
+#define CSF_STATOK	0x02	/* ... and succeeded */
+#define CSF_LSTAT	0x04	/* lstat() has been tried */
+#define CSF_LSTATOK	0x08	/* ... and succeeded */
+
+static struct condstat condstats[CONDSTAT_SIZE];
+static int condstatnext;
+
 static struct stat st;
 
+/**/
+void
+resetcondstat(void)
+{
+    int i;
+
+    for (i = 0; i < CONDSTAT_SIZE; i++)
+	if (condstats[i].name) {
+	    zsfree(condstats[i].name);
+	    condstats[i].name = NULL;
+	}
+}
+
+/* Find or make the cache entry for the unmetafied path us. */
+
+/**/
+static struct condstat *
+getcondstat(char *us)
+{
+    struct condstat *cs;
+    int i;
+
+    for (i = 0, cs = condstats; i < CONDSTAT_SIZE; i++, cs++)
+	if (cs->name && !strcmp(cs->name, us))
+	    return cs;
+    cs = condstats + condstatnext;
+    condstatnext = (condstatnext + 1) % CONDSTAT_SIZE;
+    zsfree(cs->name);
+    cs->name = ztrdup(us);
+    cs->flags = 0;
+    return cs;
+}
+
 /**/
 static struct stat *
 getstat(char *s)
 {
+    struct condstat *cs;
     char *us;
 
 /* /dev/fd/n refers to the open file descriptor n.  We always use fstat *
@@ -463,9 +523,13 @@ getstat(char *s)
 
     if (!(us = unmeta(s)))
         return NULL;
-    if (stat(us, &st))
-	return NULL;
-    return &st;
+    cs = getcondstat(us);
+    if (!(cs->flags & CSF_STAT)) {
+	cs->flags |= CSF_STAT;
+	if (!stat(us, &cs->st))
+	    cs->flags |= CSF_STATOK;
+    }
+    return (cs->flags & CSF_STATOK) ? &cs->st : NULL;
 }
 
 
@@ -487,9 +551,18 @@ dostat(char *s)
 static mode_t
 dolstat(char *s)
 {
-    if (lstat(unmeta(s), &st) < 0)
+    struct condstat *cs;
+    char *us;
+
+    if (!(us = unmeta(s)))
 	return 0;
-    return st.st_mode;
+    cs = getcondstat(us);
+    if (!(cs->flags & CSF_LSTAT)) {
+	cs->flags |= CSF_LSTAT;
+	if (!lstat(us, &cs->lst))
+	    cs->flags |= CSF_LSTATOK;
+    }
+    return (cs->flags & CSF_LSTATOK) ? cs->lst.st_mode : 0;
 }
 
 
@@ -320,6 +320,11 @@ zfork(struct timeval *tv)
     }
     if (tv)
 	gettimeofday(tv, &dummy_tz);
+    /* Don't let the child inherit a partial xtrace line */
+    if (xtrerr)
+	fflush(xtrerr);
+    /* The child may change files tested by a condition */
+    resetcondstat();
     /*
      * Queueing signals is necessary on Linux because fork()
      * manipulates mutexes, leading to deadlock in memory
@@ -1314,6 +1319,7 @@ execlist(Estate state, int dont_change_job, int exiting)
     while (wc_code(code) == WC_LIST && !breaks && !retflag && !errflag) {
 	int donedebug;
 	int this_donetrap = 0;
+	struct cmdhookdata cmdhook;
 	this_noerrexit = 0;
 
 	ltype = WC_LIST_TYPE(code);
@@ -1344,6 +1350,19 @@ execlist(Estate state, int dont_change_job, int exiting)
 		lineno = lnp1 - 1;
 	}
 
+	/* Checking the list first keeps this cheap when unused. */
+	cmdhook.prog = NULL;
+	if (nonempty(BEFORECMDHOOK->funcs) || nonempty(AFTERCMDHOOK->funcs)) {
+	    cmdhook.prog = state->prog;
+	    cmdhook.pc = state->pc;
+	    if (ltype & Z_SIMPLE) /* skip the line number */
+		cmdhook.pc++;
+	    cmdhook.lineno = lineno;
+	    cmdhook.status = lastval;
+	    if (nonempty(BEFORECMDHOOK->funcs))
+		runhookdef(BEFORECMDHOOK, &cmdhook);
+	}
+
 	if (sigtrapped[SIGDEBUG] && isset(DEBUGBEFORECMD) && !intrap) {
 	    Wordcode pc2 = state->pc;
 	    int oerrexit_opt = opts[ERREXIT];
@@ -1521,6 +1540,11 @@ sublist_done:
 	    opts[ERREXIT] = oerrexit_opt;
 	}
 
+	if (cmdhook.prog && nonempty(AFTERCMDHOOK->funcs)) {
+	    cmdhook.status = lastval;
+	    runhookdef(AFTERCMDHOOK, &cmdhook);
+	}
+
 	cmdsp = csp;
 
 	/* Check whether we are suppressing traps/errexit *
@@ -2170,6 +2194,155 @@ clobber_open(struct redir *f)
 /* size of buffer for tee and cat processes */
 #define TCBUFSIZE 4092
 
+#if defined(HAVE_TEE) && defined(HAVE_SPLICE)
+/* size we try to give the pipes used by the tee process */
+#define TCPIPESIZE (1024*1024)
+
+/* How splicemnout() is getting data to each target */
+#define MN_SPLICE	0	/* splice() from the pipe */
+#define MN_COPY		1	/* read() and write() through a buffer */
+#define MN_DEAD		2	/* writing failed, discard the data */
+
+/*
+ * Move len bytes from the pipe fd to the file descriptor out.
+ * If out can't be spliced to, copy through buf instead; if writing
+ * to it fails, throw the data away as the read() and write() loop
+ * does, so the other targets still get it.  *how records which of
+ * these applies for next time.  Returns -1 if the pipe can't be read.
+ */
+
+static int
+splicemnout(int fd, int out, ssize_t len, char *buf, char *how)
+{
+    ssize_t ret;
+
+    while (len > 0) {
+	if (*how == MN_SPLICE) {
+	    ret = splice(fd, NULL, out, NULL, len, SPLICE_F_MOVE);
+	    if (ret < 0 && errno != EINTR) {
+		/*
+		 * Nothing was moved, so we can't tell whether the
+		 * pipe or the target was at fault; copying will.
+		 */
+		*how = MN_COPY;
+		continue;
+	    }
+	} else if ((ret = read(fd, buf, len)) > 0 && *how == MN_COPY &&
+		   write_loop(out, buf, ret) < 0)
+	    *how = MN_DEAD;
+	if (ret < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (ret == 0)
+	    return -1;
+	len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Copy everything from the pipe of a multio for output to all its
+ * targets without bringing the data into user space where possible.
+ * tee() duplicates each chunk of the pipe into a scratch pipe from
+ * which it is spliced to every target but the last; the last target
+ * then consumes the chunk from the pipe itself.  Targets that can't
+ * be spliced to (terminals, files opened for appending) get copies
+ * made the usual way, and once writing to a target fails it is
+ * skipped while the others carry on.
+ *
+ * Returns 0 if the kernel doesn't support this, in which case nothing
+ * has been read from the pipe and the caller should fall back to
+ * read() and write().
+ */
+
+static int
+teemn(struct multio *mn)
+{
+    int mid[2], i, j, size, last = mn->ct - 1, started = 0;
+    ssize_t chunk, got, ret;
+    char *buf, *how;
+
+    if (pipe(mid) < 0)
+	return 0;
+#ifdef F_SETPIPE_SZ
+    /* Bigger pipes mean fewer system calls; failure is harmless. */
+    fcntl(mn->pipe, F_SETPIPE_SZ, TCPIPESIZE);
+    fcntl(mid[0], F_SETPIPE_SZ, TCPIPESIZE);
+#endif
+#ifdef F_GETPIPE_SZ
+    if ((size = fcntl(mn->pipe, F_GETPIPE_SZ)) <= 0)
+#endif
+	size = TCPIPESIZE;
+    buf = (char *)zalloc(size);
+    how = (char *)zshcalloc(mn->ct);
+
+    for (;;) {
+	chunk = 0;
+	for (i = 0; i < last; i++) {
+	    /*
+	     * The scratch pipe is empty each time, so this should
+	     * duplicate the whole of the chunk the first target got.
+	     */
+	    while ((got = tee(mn->pipe, mid[1], i ? chunk : size, 0)) < 0 &&
+		   errno == EINTR)
+		;
+	    if (got < 0) {
+		if (!started && (errno == EINVAL || errno == ENOSYS)) {
+		    close(mid[0]);
+		    close(mid[1]);
+		    zfree(buf, size);
+		    zfree(how, mn->ct);
+		    return 0;
+		}
+		goto done;
+	    }
+	    started = 1;
+	    if (!i) {
+		if (!(chunk = got))
+		    goto done;	/* end of file */
+	    }
+	    if (got && splicemnout(mid[0], mn->fds[i], got,
+				   buf, how + i) < 0)
+		goto done;
+	    if (got < chunk) {
+		/*
+		 * Partial duplication: we can't tee from the middle of
+		 * the pipe, so take the chunk out and finish it by hand.
+		 */
+		for (ret = 0; ret < chunk; ) {
+		    ssize_t r = read(mn->pipe, buf + ret, chunk - ret);
+		    if (r <= 0) {
+			if (r < 0 && errno == EINTR)
+			    continue;
+			goto done;
+		    }
+		    ret += r;
+		}
+		if (how[i] != MN_DEAD)
+		    write_loop(mn->fds[i], buf + got, chunk - got);
+		for (j = i + 1; j <= last; j++)
+		    if (how[j] != MN_DEAD)
+			write_loop(mn->fds[j], buf, chunk);
+		break;
+	    }
+	}
+	if (i == last &&
+	    splicemnout(mn->pipe, mn->fds[last], chunk,
+			buf, how + last) < 0)
+	    goto done;
+    }
+
+ done:
+    close(mid[0]);
+    close(mid[1]);
+    zfree(buf, size);
+    zfree(how, mn->ct);
+    return 1;
+}
+#endif
+
 /* close an multio (success) */
 
 /**/
@@ -2209,6 +2382,10 @@ closemn(struct multio **mfds, int fd, int type)
 	closeallelse(mn);
 	if (mn->rflag) {
 	    /* tee process */
+#if defined(HAVE_TEE) && defined(HAVE_SPLICE)
+	    if (teemn(mn))
+		_exit(0);
+#endif
 	    while ((len = read(mn->pipe, buf, TCBUFSIZE)) != 0) {
 		if (len < 0) {
 		    if (errno == EINTR)
@@ -2818,6 +2995,8 @@ execcmd_exec(Estate state, Execcmd_params eparams,
     LinkList preargs;
 
     doneps4 = 0;
+    /* The command may write to files tested by a condition */
+    resetcondstat();
 
     /*
      * If assignment but no command get the status from variable
@@ -4133,9 +4312,11 @@ execcmd_exec(Estate state, Execcmd_params eparams,
 		    _realexit();
 
 		/* If we are exec'ing a command, and we are not in a subshell, *
-		 * then check if we should save the history file.              */
+		 * then check if we should save the history file, and save     *
+		 * any commands parsed from the script.                        */
 		if (isset(RCS) && interact && !nohistsave)
 		    savehistfile(NULL, 1, HFILE_USE_OPTIONS);
+		savescriptsrc();
 		realexit();
 	    }
 	    if (restorelist)
@@ -4149,9 +4330,13 @@ execcmd_exec(Estate state, Execcmd_params eparams,
 		    setiparam("SHLVL", --shlvl);
 
 		/* If we are exec'ing a command, and we are not *
-		 * in a subshell, then save the history file.   */
-		if (do_exec && isset(RCS) && interact && !nohistsave)
-		    savehistfile(NULL, 1, HFILE_USE_OPTIONS);
+		 * in a subshell, then save the history file    *
+		 * and any commands parsed from the script.     */
+		if (do_exec) {
+		    if (isset(RCS) && interact && !nohistsave)
+			savehistfile(NULL, 1, HFILE_USE_OPTIONS);
+		    savescriptsrc();
+		}
 	    }
 	    if (type == WC_SIMPLE || type == WC_TYPESET) {
 		if (varspc) {
@@ -4534,6 +4719,17 @@ getherestr(struct redir *fn)
      */
     if (!(fn->flags & REDIRF_FROM_HEREDOC))
 	t[len++] = '\n';
+    /*
+     * Where we can, keep the text in memory rather than going
+     * via the file system.  This still gives a seekable file.
+     */
+    if ((fd = getmemfile("zsh-herestr")) >= 0) {
+	if (write_loop(fd, t, len) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+	    close(fd);
+	    return -1;
+	}
+	return fd;
+    }
     if ((fd = gettempfile(NULL, 1, &s)) < 0)
 	return -1;
     write_loop(fd, t, len);
@@ -4651,6 +4847,9 @@ getoutput(char *cmd, int qt)
     return NULL;
 }
 
+/* size of chunks in which the output of command substitution is read */
+#define READOUTPUT_BUFSIZE 8192
+
 /* read output of command substitution
  *
  * The file descriptor "in" is closed by the function.
@@ -4666,12 +4865,12 @@ mod_export LinkList
 readoutput(int in, int qt, int *readerror)
 {
     LinkList ret;
-    char *buf, *bufptr, *ptr, inbuf[64];
+    char *buf, *bufptr, *ptr, inbuf[READOUTPUT_BUFSIZE];
     int bsiz, c, cnt = 0, readret;
     int q = queue_signal_level();
 
     ret = newlinklist();
-    ptr = buf = (char *) hcalloc(bsiz = 64);
+    ptr = buf = (char *) zhalloc(bsiz = 64);
     /*
      * We need to be sensitive to SIGCHLD else we can be
      * stuck forever with important processes unreaped.
@@ -4682,7 +4881,7 @@ readoutput(int in, int qt, int *readerror)
     dont_queue_signals();
     child_unblock();
     for (;;) {
-	readret = read(in, inbuf, 64);
+	readret = read(in, inbuf, READOUTPUT_BUFSIZE);
 	if (readret <= 0) {
 	    if (readret < 0 && errno == EINTR)
 		continue;
@@ -4699,7 +4898,7 @@ readoutput(int in, int qt, int *readerror)
 	    if (++cnt >= bsiz) {
 		char *pp;
 		queue_signals();
-		pp = (char *) hcalloc(bsiz *= 2);
+		pp = (char *) zhalloc(bsiz *= 2);
 		dont_queue_signals();
 
 		memcpy(pp, buf, cnt - 1);
@@ -4782,8 +4981,6 @@ getoutputfile(char *cmd, char **eptr)
     }
     if (!(prog = parsecmd(cmd, eptr)))
 	return NULL;
-    if (!(nam = gettempname(NULL, 1)))
-	return NULL;
 
     if ((s = simple_redir_name(prog, REDIR_HERESTR))) {
 	/*
@@ -4801,9 +4998,12 @@ getoutputfile(char *cmd, char **eptr)
     if (!s)             /* Unclear why we need to do this before open() */
 	child_block();  /* but it has been so for a long time: leave it */
 
-    if ((fd = open(nam, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY, 0600)) < 0) {
+    /*
+     * gettempfile() creates the file in one go, rather than finding
+     * an unused name and then opening it.
+     */
+    if ((fd = gettempfile(NULL, 1, &nam)) < 0) {
 	zerr("process substitution failed: %e", errno);
-	free(nam);
 	if (!s)
 	    child_unblock();
 	return NULL;
@@ -5076,6 +5276,7 @@ execcond(Estate state, UNUSED(int do_exec))
 	tracingcond++;
     }
     cmdpush(CS_COND);
+    resetcondstat();
     stat = evalcond(state, NULL);
     /*
      * 2 indicates a syntax error.  For compatibility, turn this
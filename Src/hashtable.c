@@ -1122,12 +1122,12 @@ createreswdtable(void)
     reswdtab->emptytable  = NULL;
     reswdtab->filltable   = NULL;
     reswdtab->cmpnodes    = strcmp;
-    reswdtab->addnode     = addhashnode;
+    reswdtab->addnode     = addaliasnode;
     reswdtab->getnode     = gethashnode;
     reswdtab->getnode2    = gethashnode2;
-    reswdtab->removenode  = NULL;
-    reswdtab->disablenode = disablehashnode;
-    reswdtab->enablenode  = enablehashnode;
+    reswdtab->removenode  = removealiasnode;
+    reswdtab->disablenode = disablealiasnode;
+    reswdtab->enablenode  = enablealiasnode;
     reswdtab->freenode    = NULL;
     reswdtab->printnode   = printreswdnode;
 
@@ -1175,6 +1175,115 @@ mod_export HashTable aliastab;
 
 /**/
 mod_export HashTable sufaliastab;
+
+/*
+ * Incremented whenever an alias or reserved word is added, removed,
+ * enabled or disabled, as that changes how later input is parsed.
+ */
+
+static zlong aliasgen, aliashashgen = -1;
+static zulong aliashashval;
+
+/*
+ * 64-bit FNV-1a hash of len bytes at s, or of the string s if len is
+ * negative.  Used where a summary of some state is compared instead of
+ * a full copy, so collisions should be very unlikely.
+ */
+
+/**/
+zulong
+hashbytes(const char *s, int len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    zulong h = (zulong)0xcbf29ce484222325ULL;
+
+    if (len < 0)
+	len = strlen(s);
+    while (len--)
+	h = (h ^ *p++) * (zulong)0x100000001b3ULL;
+    return h;
+}
+
+/**/
+static zulong
+aliastabhash(HashTable ht, int isalias)
+{
+    HashNode hn;
+    zulong sum = 0, h;
+    int i;
+
+    for (i = 0; i < ht->hsize; i++)
+	for (hn = ht->nodes[i]; hn; hn = hn->next) {
+	    h = hashbytes(hn->nam, -1) ^ (zulong)hn->flags;
+	    if (isalias)
+		h = (h * 31) ^ hashbytes(((Alias)hn)->text, -1);
+	    /* added so the order of nodes in the table doesn't matter */
+	    sum += h * (zulong)0x100000001b3ULL;
+	}
+    return sum;
+}
+
+/*
+ * Return a value summarising the aliases and reserved words that are
+ * defined, so that code saved after parsing can tell if it would
+ * now be parsed differently.
+ */
+
+/**/
+zulong
+aliasstate(void)
+{
+    if (aliashashgen != aliasgen) {
+	aliashashval = aliastabhash(aliastab, 1) +
+	    3 * aliastabhash(sufaliastab, 1) + 5 * aliastabhash(reswdtab, 0);
+	aliashashgen = aliasgen;
+    }
+    return aliashashval;
+}
+
+/*
+ * Return the current alias generation, for code that only needs to
+ * know whether the aliases have changed since it last looked.
+ */
+
+/**/
+mod_export zlong
+getaliasgen(void)
+{
+    return aliasgen;
+}
+
+/**/
+static void
+addaliasnode(HashTable ht, char *nam, void *nodeptr)
+{
+    aliasgen++;
+    addhashnode(ht, nam, nodeptr);
+}
+
+/**/
+static HashNode
+removealiasnode(HashTable ht, const char *nam)
+{
+    aliasgen++;
+    return removehashnode(ht, nam);
+}
+
+/**/
+static void
+disablealiasnode(HashNode hn, int flags)
+{
+    aliasgen++;
+    disablehashnode(hn, flags);
+}
+
+/**/
+static void
+enablealiasnode(HashNode hn, int flags)
+{
+    aliasgen++;
+    enablehashnode(hn, flags);
+}
  
 /* Create new hash tables for aliases */
 
@@ -1186,12 +1295,12 @@ createaliastable(HashTable ht)
     ht->emptytable  = NULL;
     ht->filltable   = NULL;
     ht->cmpnodes    = strcmp;
-    ht->addnode     = addhashnode;
+    ht->addnode     = addaliasnode;
     ht->getnode     = gethashnode;
     ht->getnode2    = gethashnode2;
-    ht->removenode  = removehashnode;
-    ht->disablenode = disablehashnode;
-    ht->enablenode  = enablehashnode;
+    ht->removenode  = removealiasnode;
+    ht->disablenode = disablealiasnode;
+    ht->enablenode  = enablealiasnode;
     ht->freenode    = freealiasnode;
     ht->printnode   = printaliasnode;
 }
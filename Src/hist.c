@@ -1922,6 +1922,38 @@ chabspath(char **junkptr)
     return 1;
 }
 
+#ifdef HAVE_REALPATH
+/*
+ * Return the absolute directory dir with symbolic links resolved, on
+ * the heap, using the cache shared with xsymlinks() where possible.
+ */
+
+/**/
+static char *
+realdir(char *dir)
+{
+    char *real, *res;
+# ifndef REALPATH_ACCEPTS_NULL
+    char pathbuf[PATH_MAX+1];
+# endif
+
+    if ((res = getresolveddir(dir)))
+	return dupstring(res);
+# ifdef REALPATH_ACCEPTS_NULL
+    if (!(real = realpath(unmeta(dir), NULL)))
+	return NULL;
+    res = metafy(real, -1, META_HEAPDUP);
+    free(real);
+# else
+    if (!(real = realpath(unmeta(dir), pathbuf)))
+	return NULL;
+    res = metafy(real, -1, META_HEAPDUP);
+# endif
+    addresolveddir(dir, res);
+    return res;
+}
+#endif
+
 /**/
 int
 chrealpath(char **junkptr)
@@ -1953,6 +1985,29 @@ chrealpath(char **junkptr)
     if (**junkptr != '/')
 	return 0;
 
+    /*
+     * If the directory part can be resolved from the cache, and the
+     * last component isn't itself a link, we needn't resolve the
+     * whole path again.  A missing last component is added as it is,
+     * as below.
+     */
+    if ((lastpos = strrchr(*junkptr, '/')) != *junkptr &&
+	strcmp(lastpos, "/.") && strcmp(lastpos, "/..")) {
+	struct stat st;
+
+	*lastpos = '\0';
+	str = realdir(*junkptr);
+	*lastpos = '/';
+	if (str) {
+	    str = str[1] ? dyncat(str, lastpos) : dupstring(lastpos);
+	    if (lstat(unmeta(str), &st) ? errno == ENOENT :
+		!S_ISLNK(st.st_mode)) {
+		*junkptr = str;
+		return 1;
+	    }
+	}
+    }
+
     unmetafy(*junkptr, NULL);
 
     lastpos = strend(*junkptr);
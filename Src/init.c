@@ -32,6 +32,8 @@
 #include "zshpaths.h"
 #include "zshxmods.h"
 
+struct srcfile;
+
 #include "init.pro"
 
 #include "version.h"
@@ -75,6 +77,24 @@ mod_export char *tcstr[TC_COUNT];
 /**/
 mod_export int tclen[TC_COUNT];
 
+/*
+ * Incremented whenever the terminal definition is loaded, so that
+ * anything caching capabilities can tell its copy is stale.
+ */
+
+/**/
+mod_export int termgen;
+
+/*
+ * Expansions of parameterised termcap strings for small arguments,
+ * such as cursor motions and colours.  Each row is allocated when
+ * first used and indexed by the argument.
+ */
+
+#define TCARGCACHE 256
+
+static char **tcargcache[TC_COUNT];
+
 /* Values of the li, co and am entries */
 
 /**/
@@ -98,8 +118,48 @@ mod_export struct hookdef zshhooks[] = {
     HOOKDEF("before_trap", NULL, HOOKF_ALL),
     HOOKDEF("after_trap", NULL, HOOKF_ALL),
     HOOKDEF("get_color_attr", NULL, HOOKF_ALL),
+    HOOKDEF("before_command", NULL, HOOKF_ALL),
+    HOOKDEF("after_command", NULL, HOOKF_ALL),
+};
+
+/*
+ * Cache of files read by source, i.e. the "." and "source" builtins
+ * and the startup files.  Each top-level command parsed from a file
+ * is saved together with the options and aliases in force when it was
+ * parsed, so that sourcing the same, unchanged file again can run the
+ * saved code without lexing and parsing it.  If the options or aliases
+ * differ when a saved command is reached, the rest of the file is read
+ * afresh from the end of the previous command.  As most files are only
+ * sourced once, nothing is saved for a file until it is sourced again.
+ */
+
+struct srccmd {
+    Eprog prog;			/* permanent copy of the parsed command */
+    zulong options;		/* optionstate() when parsed */
+    zulong aliases;		/* aliasstate() when parsed */
+    off_t offset;		/* file offset after the command */
+    zlong lineno;		/* line number after the command */
 };
 
+struct srcfile {
+    struct hashnode node;	/* named by device and inode */
+    off_t size;			/* size and modification time when */
+    time_t mtime;		/*   the commands were saved       */
+    long mtimens;
+    struct srccmd *cmds;	/* saved commands */
+    int ncmds;
+    int complete;		/* commands cover the whole file */
+    int busy;			/* being read, don't change */
+    int dirty;			/* changed since loaded from a script cache */
+    int again;			/* sourced before, so worth saving commands */
+};
+
+static HashTable srcfiletab;
+
+/* The cache entry the next call to loop() should save commands in */
+
+static struct srcfile *srcrecord;
+
 /* keep executing lists until EOF found */
 
 /**/
@@ -108,6 +168,9 @@ loop(int toplevel, int justonce)
 {
     Eprog prog;
     int err, non_empty = 0;
+    struct srcfile *rec = srcrecord;
+
+    srcrecord = NULL;
 
     queue_signals();
     pushheap();
@@ -150,6 +213,8 @@ loop(int toplevel, int justonce)
 	if (!(prog = parse_event(ENDINPUT))) {
 	    /* if we couldn't parse a list */
 	    hend(NULL);
+	    if (rec && tok == ENDINPUT && !errflag)
+		rec->complete = 1;
 	    if ((tok == ENDINPUT && !errflag) ||
 		(tok == LEXERR && (!isset(SHINSTDIN) || !toplevel)) ||
 		justonce)
@@ -171,49 +236,18 @@ loop(int toplevel, int justonce)
 	    enum lextok toksav = tok;
 
 	    non_empty = 1;
-	    if (toplevel &&
-		(getshfunc("preexec") ||
-		 paramtab->getnode(paramtab, "preexec" HOOK_SUFFIX))) {
-		LinkList args;
-		char *cmdstr;
-
-		/*
-		 * As we're about to freeheap() or popheap()
-		 * anyway, there's no gain in using permanent
-		 * storage here.
-		 */
-		args = newlinklist();
-		addlinknode(args, "preexec");
-		/* If curline got dumped from the history, we don't know
-		 * what the user typed. */
-		if (hist_ring && curline.histnum == curhist)
-		    addlinknode(args, hist_ring->node.nam);
-		else
-		    addlinknode(args, "");
-		addlinknode(args, dupstring(getjobtext(prog, NULL)));
-		addlinknode(args, cmdstr = getpermtext(prog, NULL, 0));
-
-		callhookfunc("preexec", args, 1, NULL);
-
-		/* The only permanent storage is from getpermtext() */
-		zsfree(cmdstr);
-		/*
-		 * Note this does *not* remove a user interrupt error
-		 * condition, even though we're at the top level loop:
-		 * that would be inconsistent with the case where
-		 * we didn't execute a preexec function.  This is
-		 * an implementation detail that an interrupting user
-		 * doesn't care about.
-		 */
-		errflag &= ~ERRFLAG_ERROR;
-	    }
+	    if (rec && !addsrccmd(rec, prog))
+		rec = NULL;
+	    if (toplevel)
+		callpreexec(prog);
 	    if (stopmsg)	/* unset 'you have stopped jobs' flag */
 		stopmsg--;
 	    execode(prog, 0, 0, toplevel ? "toplevel" : "file");
 	    tok = toksav;
 	    if (toplevel)
 		noexitct = 0;
-	}
+	} else
+	    rec = NULL;
 	if (ferror(stderr)) {
 	    zerr("write error");
 	    clearerr(stderr);
@@ -794,9 +828,18 @@ init_term(void)
 
 	termflags &= ~TERM_BAD;
 	termflags &= ~TERM_UNKNOWN;
+	termgen++;
 	for (t0 = 0; t0 != TC_COUNT; t0++) {
 	    pp = tbuf;
 	    zsfree(tcstr[t0]);
+	    if (tcargcache[t0]) {
+		int arg;
+
+		for (arg = 0; arg < TCARGCACHE; arg++)
+		    zsfree(tcargcache[t0][arg]);
+		zfree(tcargcache[t0], TCARGCACHE * sizeof(char *));
+		tcargcache[t0] = NULL;
+	    }
 	/* AIX tgetstr() ignores second argument */
 	    if (!(pp = tgetstr(tccapnams[t0], &pp)))
 		tcstr[t0] = NULL, tclen[t0] = 0;
@@ -869,6 +912,27 @@ init_term(void)
     return 1;
 }
 
+/*
+ * Expand the termcap string for cap with the argument arg, as
+ * tgoto(tcstr[cap], arg, arg) would.  The result is not to be freed
+ * and is only valid until the terminal is next initialised.
+ */
+
+/**/
+mod_export char *
+tcgoto(int cap, int arg)
+{
+    char **row;
+
+    if (arg < 0 || arg >= TCARGCACHE)
+	return tgoto(tcstr[cap], arg, arg);
+    if (!(row = tcargcache[cap]))
+	row = tcargcache[cap] = (char **)zshcalloc(TCARGCACHE * sizeof(char *));
+    if (!row[arg])
+	row[arg] = ztrdup(tgoto(tcstr[cap], arg, arg));
+    return row[arg];
+}
+
 /* Initialize lots of global variables and hash tables */
 
 /**/
@@ -1079,20 +1143,27 @@ setupvals(char *cmd, char *runscript, char *zsh_name)
      * recheck the info for `USERNAME'     */
     cached_uid = getuid();
 
-    /* Get password entry and set info for `USERNAME' */
+    /*
+     * The password entry is only needed here for the default `HOME'.
+     * Reading it can be slow, so if HOME is in the environment, which
+     * will replace the default anyway, leave `USERNAME' to be looked
+     * up when it's first used (see get_username()).
+     */
+    if (EMULATION(EMULATE_ZSH)) {
+	if ((ptr = zgetenv("HOME")))
+	    home = metafy(ptr, -1, META_DUP);
 #ifdef USE_GETPWUID
-    if ((pswd = getpwuid(cached_uid))) {
-	if (EMULATION(EMULATE_ZSH))
+	else if ((pswd = getpwuid(cached_uid))) {
 	    home = metafy(pswd->pw_dir, -1, META_DUP);
-	cached_username = ztrdup(pswd->pw_name);
-    }
-    else
+	    cached_username = ztrdup(pswd->pw_name);
+	}
 #endif /* USE_GETPWUID */
-    {
-	if (EMULATION(EMULATE_ZSH))
+	else
 	    home = ztrdup("/");
-	cached_username = ztrdup("");
     }
+#ifndef USE_GETPWUID
+    cached_username = ztrdup("");
+#endif
 
     /*
      * Try a cheap test to see if we can initialize `PWD' from `HOME'.
@@ -1389,6 +1460,446 @@ init_misc(char *cmd, char *zsh_name)
 	readhistfile(NULL, 0, HFILE_USE_OPTIONS);
 }
 
+/* Forget the commands saved for a file from the n'th on. */
+
+/**/
+static void
+truncsrccmds(struct srcfile *sf, int n)
+{
+    int i;
+
+    if (n < sf->ncmds) {
+	for (i = n; i < sf->ncmds; i++)
+	    freeeprog(sf->cmds[i].prog);
+	if (n)
+	    sf->cmds = zrealloc(sf->cmds, n * sizeof(*sf->cmds));
+	else {
+	    zfree(sf->cmds, sf->ncmds * sizeof(*sf->cmds));
+	    sf->cmds = NULL;
+	}
+	sf->ncmds = n;
+	sf->dirty = 1;
+    }
+    sf->complete = 0;
+}
+
+/**/
+static void
+freesrcfile(HashNode hn)
+{
+    struct srcfile *sf = (struct srcfile *)hn;
+
+    truncsrccmds(sf, 0);
+    zsfree(sf->node.nam);
+    zfree(sf, sizeof(*sf));
+}
+
+/**/
+static HashTable
+newsrcfiletable(void)
+{
+    HashTable ht = newhashtable(31, "srcfiletab", NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = freesrcfile;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
+/*
+ * Find the cache entry for the file open for reading commands on fd,
+ * creating it if necessary.  Commands saved for an older version of
+ * the file are forgotten.  Returns NULL if the file isn't a regular
+ * file, or if it is already being read so the entry can't be changed.
+ */
+
+/**/
+static struct srcfile *
+getsrcfile(int fd)
+{
+    struct srcfile *sf;
+    struct stat st;
+    char buf[2 * DIGBUFSIZE + 2];
+    long mtimens;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+	return NULL;
+#ifdef GET_ST_MTIME_NSEC
+    mtimens = GET_ST_MTIME_NSEC(st);
+#else
+    mtimens = 0;
+#endif
+    if (!srcfiletab)
+	srcfiletab = newsrcfiletable();
+    sprintf(buf, "%lx-%lx", (unsigned long)st.st_dev,
+	    (unsigned long)st.st_ino);
+    if ((sf = (struct srcfile *)srcfiletab->getnode(srcfiletab, buf))) {
+	if (sf->busy)
+	    return NULL;
+	if (sf->size == st.st_size && sf->mtime == st.st_mtime &&
+	    sf->mtimens == mtimens)
+	    return sf;
+	truncsrccmds(sf, 0);
+    } else {
+	sf = (struct srcfile *)zshcalloc(sizeof(*sf));
+	srcfiletab->addnode(srcfiletab, ztrdup(buf), sf);
+    }
+    sf->size = st.st_size;
+    sf->mtime = st.st_mtime;
+    sf->mtimens = mtimens;
+    return sf;
+}
+
+/*
+ * Save a command just parsed by loop() from a file.  Returns 0 if the
+ * position in the file after the command isn't known, in which case
+ * nothing more can be saved.
+ */
+
+/**/
+static int
+addsrccmd(struct srcfile *sf, Eprog prog)
+{
+    struct srccmd *sc;
+    off_t offset;
+
+    if (inbufct || (offset = ftell(bshin)) < 0)
+	return 0;
+    sf->cmds = zrealloc(sf->cmds, (sf->ncmds + 1) * sizeof(*sf->cmds));
+    sc = sf->cmds + sf->ncmds++;
+    sc->prog = dupeprog(prog, 0);
+    sc->options = optionstate();
+    sc->aliases = aliasstate();
+    sc->offset = offset;
+    sc->lineno = lineno;
+    sf->dirty = 1;
+    return 1;
+}
+
+/* Continue reading the file open as bshin after the n'th saved command. */
+
+/**/
+static void
+seeksrcfile(struct srcfile *sf, int n)
+{
+    if (n) {
+	fseek(bshin, sf->cmds[n - 1].offset, SEEK_SET);
+	lineno = sf->cmds[n - 1].lineno;
+    }
+}
+
+/* Call the preexec hooks as loop() does before running prog. */
+
+/**/
+static void
+callpreexec(Eprog prog)
+{
+    LinkList args;
+    char *cmdstr;
+
+    if (!getshfunc("preexec") &&
+	!paramtab->getnode(paramtab, "preexec" HOOK_SUFFIX))
+	return;
+    /*
+     * As we're about to freeheap() or popheap()
+     * anyway, there's no gain in using permanent
+     * storage here.
+     */
+    args = newlinklist();
+    addlinknode(args, "preexec");
+    /* If curline got dumped from the history, we don't know
+     * what the user typed. */
+    if (hist_ring && curline.histnum == curhist)
+	addlinknode(args, hist_ring->node.nam);
+    else
+	addlinknode(args, "");
+    addlinknode(args, dupstring(getjobtext(prog, NULL)));
+    addlinknode(args, cmdstr = getpermtext(prog, NULL, 0));
+
+    callhookfunc("preexec", args, 1, NULL);
+
+    /* The only permanent storage is from getpermtext() */
+    zsfree(cmdstr);
+    /*
+     * Note this does *not* remove a user interrupt error
+     * condition, even though we're at the top level loop:
+     * that would be inconsistent with the case where
+     * we didn't execute a preexec function.  This is
+     * an implementation detail that an interrupting user
+     * doesn't care about.
+     */
+    errflag &= ~ERRFLAG_ERROR;
+}
+
+/*
+ * Run the commands saved for a file, which is open as bshin.  This
+ * does what loop(toplevel, 0) would do for the file as far as the saved
+ * commands go.  The rest of the file, or everything from a command
+ * parsed under different options or aliases, is handed to loop(),
+ * which saves the commands it reads in place of those not used.
+ */
+
+/**/
+static enum loop_return
+runsrcfile(struct srcfile *sf, int toplevel)
+{
+    struct srccmd *sc;
+    enum loop_return ret;
+    int i, err, non_empty = 0;
+
+    queue_signals();
+    pushheap();
+    for (i = 0, sc = sf->cmds; i < sf->ncmds; i++, sc++) {
+	if (sc->options != optionstate() || sc->aliases != aliasstate())
+	    break;
+	freeheap();
+	use_exit_printed = 0;
+	intr();
+	non_empty = 1;
+	if (toplevel)
+	    callpreexec(sc->prog);
+	if (stopmsg)
+	    stopmsg--;
+	execode(sc->prog, 0, 0, toplevel ? "toplevel" : "file");
+	if (toplevel)
+	    noexitct = 0;
+	if (ferror(stderr)) {
+	    zerr("write error");
+	    clearerr(stderr);
+	}
+	if (subsh)
+	    realexit();
+	if (errflag || retflag) {
+	    i++;
+	    break;
+	}
+    }
+    err = errflag;
+    popheap();
+    unqueue_signals();
+
+    if (err || retflag) {
+	/* The caller may carry on reading after the command */
+	if (toplevel) {
+	    seeksrcfile(sf, i);
+	    tok = NEWLIN;
+	}
+	return err ? LOOP_ERROR : non_empty ? LOOP_OK : LOOP_EMPTY;
+    }
+    if (i == sf->ncmds && sf->complete) {
+	tok = ENDINPUT;
+	return non_empty ? LOOP_OK : LOOP_EMPTY;
+    }
+    seeksrcfile(sf, i);
+    if (sf->busy == 1) {
+	truncsrccmds(sf, i);
+	srcrecord = sf;
+    }
+    ret = loop(toplevel, 0);
+    if (ret == LOOP_EMPTY && non_empty)
+	ret = LOOP_OK;
+    return ret;
+}
+
+/*
+ * The commands parsed from a script run by the shell can be saved in a
+ * wordcode file in the directory named by $ZSH_SCRIPT_CACHE, so later
+ * runs of the same script don't need to parse it.  Each command is
+ * stored as an entry named, in hexadecimal,
+ *   <size>.<mtime>.<mtime nsec>/<offset>.<lineno>.<options>.<aliases>.<complete>
+ * where the part before the slash identifies the version of the script
+ * the commands came from.
+ */
+
+static struct srcfile *scriptsrc;	/* cache entry for the script */
+static char *scriptdump;		/* wordcode file, without .zwc */
+static pid_t scriptpid;			/* the shell that may write it */
+
+#define SCRIPTNAMESIZE (8 * (2 * sizeof(zulong) + 1) + 1)
+
+/**/
+static char *
+addhexname(char *p, zulong v, int sep)
+{
+    char buf[2 * sizeof(zulong) + 1], *q = buf + sizeof(buf);
+
+    *--q = '\0';
+    do {
+	*--q = "0123456789abcdef"[v & 15];
+	v >>= 4;
+    } while (v);
+    while (*q)
+	*p++ = *q++;
+    *p++ = sep;
+    *p = '\0';
+    return p;
+}
+
+/**/
+static char *
+gethexname(char *p, zulong *vp, int sep)
+{
+    static char digits[] = "0123456789abcdef";
+    zulong v = 0;
+    char *q;
+
+    if (*p == sep)
+	return NULL;
+    for (; *p != sep; p++) {
+	if (!*p || !(q = strchr(digits, *p)))
+	    return NULL;
+	v = (v << 4) | (q - digits);
+    }
+    *vp = v;
+    return p + 1;
+}
+
+/* Fill the cache entry for the script from its wordcode file. */
+
+/**/
+static void
+loadscriptsrc(struct srcfile *sf)
+{
+    char **names, key[SCRIPTNAMESIZE], *p;
+    Eprog *progs;
+    zulong v[5];
+    int i, j, n, keylen;
+
+    if ((n = read_script_dump(scriptdump, &names, &progs)) <= 0)
+	return;
+    p = addhexname(key, (zulong)sf->size, '.');
+    p = addhexname(p, (zulong)sf->mtime, '.');
+    keylen = addhexname(p, (zulong)sf->mtimens, '/') - key;
+
+    sf->cmds = (struct srccmd *) zalloc(n * sizeof(*sf->cmds));
+    for (i = 0; i < n; i++) {
+	struct srccmd *sc = sf->cmds + i;
+
+	if (strncmp(names[i], key, keylen))
+	    break;
+	for (j = 0, p = names[i] + keylen; p && j < 5; j++)
+	    p = gethexname(p, v + j, j < 4 ? '.' : '\0');
+	if (!p)
+	    break;
+	sc->prog = progs[i];
+	sc->offset = (off_t)v[0];
+	sc->lineno = (zlong)v[1];
+	sc->options = v[2];
+	sc->aliases = v[3];
+	sf->complete = (v[4] != 0);
+    }
+    if (i == n)
+	sf->ncmds = n;
+    else {
+	/* An old version of the script: ignore it all */
+	for (i = 0; i < n; i++)
+	    freeeprog(progs[i]);
+	zfree(sf->cmds, n * sizeof(*sf->cmds));
+	sf->cmds = NULL;
+	sf->complete = 0;
+    }
+    for (i = 0; i < n; i++)
+	zsfree(names[i]);
+    zfree(names, n * sizeof(char *));
+    zfree(progs, n * sizeof(Eprog));
+    sf->dirty = 0;
+}
+
+/*
+ * Write the script's wordcode file if there are new commands.  This is
+ * done on exit, or before the shell running the script execs a command.
+ */
+
+/**/
+void
+savescriptsrc(void)
+{
+    struct srcfile *sf = scriptsrc;
+    char **names, key[SCRIPTNAMESIZE], *p;
+    Eprog *progs;
+    int i;
+
+    if (!sf || !sf->dirty || !sf->ncmds || getpid() != scriptpid)
+	return;
+    names = (char **) zhalloc(sf->ncmds * sizeof(char *));
+    progs = (Eprog *) zhalloc(sf->ncmds * sizeof(Eprog));
+    p = addhexname(key, (zulong)sf->size, '.');
+    p = addhexname(p, (zulong)sf->mtime, '.');
+    addhexname(p, (zulong)sf->mtimens, '/');
+    for (i = 0; i < sf->ncmds; i++) {
+	struct srccmd *sc = sf->cmds + i;
+
+	names[i] = p = (char *) zhalloc(SCRIPTNAMESIZE);
+	strcpy(p, key);
+	p += strlen(p);
+	p = addhexname(p, (zulong)sc->offset, '.');
+	p = addhexname(p, (zulong)sc->lineno, '.');
+	p = addhexname(p, sc->options, '.');
+	p = addhexname(p, sc->aliases, '.');
+	addhexname(p, (zulong)sf->complete, '\0');
+	progs[i] = sc->prog;
+    }
+    write_script_dump(scriptdump, names, progs, sf->ncmds);
+    sf->dirty = 0;
+}
+
+/**/
+static int
+savescriptsrchook(UNUSED(Hookdef d), UNUSED(void *dummy))
+{
+    savescriptsrc();
+    return 0;
+}
+
+/*
+ * Set up the cache for the script open on fd, if $ZSH_SCRIPT_CACHE
+ * names a directory belonging to us and not writable by others,
+ * creating it if needed.  Returns the entry to run with runsrcfile().
+ */
+
+/**/
+static struct srcfile *
+getscriptsrc(int fd)
+{
+    struct srcfile *sf;
+    struct stat st;
+    char *dir;
+
+    if (!(dir = getsparam("ZSH_SCRIPT_CACHE")) || !*dir ||
+	isset(SINGLECOMMAND) || isset(SHINSTDIN))
+	return NULL;
+    /* The script may change directory before the file is written */
+    if (*dir != '/')
+	dir = zhtricat(metafy(zgetcwd(), -1, META_HEAPDUP), "/", dir);
+    dir = dupstring(unmeta(dir));
+    if (stat(dir, &st) < 0 &&
+	(mkdir(dir, 0700) < 0 || stat(dir, &st) < 0))
+	return NULL;
+    if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() ||
+	(st.st_mode & 022) || !(sf = getsrcfile(fd)))
+	return NULL;
+
+    scriptdump = zhtricat(dir, "/", sf->node.nam);
+    scriptdump = ztrdup(scriptdump);
+    if (!sf->ncmds && !sf->complete)
+	loadscriptsrc(sf);
+    sf->busy++;
+    scriptsrc = sf;
+    scriptpid = getpid();
+    addhookfunc("exit", savescriptsrchook);
+    return sf;
+}
+
 /*
  * source a file
  * Returns one of the SOURCE_* enum values.
@@ -1409,6 +1920,7 @@ source(char *s)
     int ocsp;
     int otrap_return = trap_return, otrap_state = trap_state;
     struct funcstack fstack;
+    struct srcfile *sf = NULL;
     enum source_return ret = SOURCE_OK;
 
     if (!s || 
@@ -1433,6 +1945,10 @@ source(char *s)
     if (!prog) {
 	SHIN = tempfd;
 	bshin = fdopen(SHIN, "r");
+	if ((sf = getsrcfile(SHIN)) && !sf->again) {
+	    sf->again = 1;
+	    sf = NULL;
+	}
     }
     subsh  = 0;
     lineno = 1;
@@ -1443,7 +1959,8 @@ source(char *s)
 
     if (isset(SOURCETRACE)) {
 	printprompt4();
-	fprintf(xtrerr ? xtrerr : stderr, "<sourcetrace>\n");
+	fprintf(xtrerr, "<sourcetrace>\n");
+	fflush(xtrerr);
     }
 
     /*
@@ -1474,7 +1991,9 @@ source(char *s)
 	    ret = SOURCE_ERROR;
     } else {
 	/* loop through the file to be sourced  */
-	switch (loop(0, 0))
+	if (sf)
+	    sf->busy++;
+	switch (sf ? runsrcfile(sf, 0) : loop(0, 0))
 	{
 	case LOOP_OK:
 	    /* nothing to do but compilers like a complete enum */
@@ -1489,6 +2008,8 @@ source(char *s)
 	    ret = SOURCE_ERROR;
 	    break;
 	}
+	if (sf)
+	    sf->busy--;
     }
     funcstack = funcstack->prev;
     sourcelevel--;
@@ -1706,6 +2227,7 @@ mod_export int
 zsh_main(UNUSED(int argc), char **argv)
 {
     char **t, *runscript = NULL, *zsh_name;
+    struct srcfile *sf = NULL;
     char *cmd;			/* argument to -c */
     int t0;
 #ifdef USE_LOCALE
@@ -1766,6 +2288,9 @@ zsh_main(UNUSED(int argc), char **argv)
     setupshin(runscript);
     init_misc(cmd, zsh_name);
 
+    if (runscript)
+	sf = getscriptsrc(SHIN);
+
     for (;;) {
 	/*
 	 * See if we can free up some of jobtab.
@@ -1778,7 +2303,11 @@ zsh_main(UNUSED(int argc), char **argv)
 	do {
 	    /* Reset return from top level which gets us back here */
 	    retflag = 0;
-	    loop(1,0);
+	    if (sf) {
+		runsrcfile(sf, 1);
+		sf = NULL;
+	    } else
+		loop(1,0);
 	    if (errflag && !interact && !isset(CONTINUEONERROR)) {
 		errexit = 1;
 		break;
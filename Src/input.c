@@ -98,7 +98,7 @@ mod_export int inbufct;
 /* the flags controlling the input routines in input.c: see INP_* in zsh.h */
 
 /**/
-int inbufflags;
+mod_export int inbufflags;
 
 static char *inbuf;		/* Current input buffer */
 static char *inbufptr;		/* Pointer into input buffer */
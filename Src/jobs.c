@@ -1569,6 +1569,51 @@ waitforpid(pid_t pid, int wait_cmd)
     return 0;
 }
 
+/*
+ * Wait for any one of the n background processes in pids to finish.
+ * Return its index, and store the status the wait builtin would give
+ * for it in *statp; return -1 if interrupted first.
+ */
+
+/**/
+mod_export int
+waitforanypid(pid_t *pids, int n, int *statp)
+{
+    int i, j, q = queue_signal_level();
+
+    dont_queue_signals();
+    child_block();		/* unblocked in signal_suspend() */
+    for (;;) {
+	/* as in waitforpid(), ESRCH means the child has been reaped */
+	for (i = 0; i < n; i++)
+	    if (kill(pids[i], 0) < 0 && errno == ESRCH)
+		break;
+	if (i < n || errflag)
+	    break;
+	signal_suspend(SIGCHLD, 0);
+	child_block();
+    }
+    child_unblock();
+    restore_queue_signals(q);
+
+    if (i == n)
+	return -1;
+    if ((*statp = getbgstatus(pids[i])) < 0)
+	*statp = 127;
+    /*
+     * Report and free the finished job as scanjobs() would;
+     * findproc() no longer sees it.
+     */
+    for (j = 1; j <= maxjob; j++)
+	if ((jobtab[j].stat & (STAT_DONE|STAT_CHANGED)) ==
+	    (STAT_DONE|STAT_CHANGED) &&
+	    jobtab[j].procs && jobtab[j].procs->pid == pids[i]) {
+	    printjob(jobtab + j, !!isset(LONGLISTJOBS), 1);
+	    break;
+	}
+    return i;
+}
+
 /*
  * Wait for a job to finish.
  * wait_cmd indicates this is from the wait builtin; see
@@ -2214,11 +2259,13 @@ addbgstatus(pid_t pid, int status)
  * Note we make no guarantee that the PIDs haven't wrapped, so this
  * may not be the right process.
  *
- * This is only used by wait, which must only work on each
- * pid once, so we need to remove the entry if we find it.
+ * This is only used by wait and waitforanypid(), which must only work
+ * on each pid once, so we need to remove the entry if we find it.
  */
 
-static int getbgstatus(pid_t pid)
+/**/
+static int
+getbgstatus(pid_t pid)
 {
     LinkNode node;
     Bgstatus bgstatus_entry;
@@ -72,12 +72,12 @@ mod_export int isfirstln;
 /* if != 0, this is the first char of the command (not including white space) */
  
 /**/
-int isfirstch;
+mod_export int isfirstch;
 
 /* flag that an alias should be expanded after expansion ending in space */
 
 /**/
-int inalmore;
+mod_export int inalmore;
 
 /*
  * Don't do spelling correction.
@@ -87,7 +87,7 @@ int inalmore;
  */
  
 /**/
-int nocorrect;
+mod_export int nocorrect;
 
 /*
  * TBD: the following exported variables are part of the non-interface
@@ -1027,3 +1027,16 @@ void list_emulate_options(char *cmdopts, int fully)
     print_emulate_opts = cmdopts;
     scanhashtable(optiontab, 1, 0, 0, print_emulate_option, fully);
 }
+
+/*
+ * Return a value summarising the current option settings, so that
+ * code saved after parsing can tell if it would now be parsed
+ * differently.
+ */
+
+/**/
+zulong
+optionstate(void)
+{
+    return hashbytes(opts, OPT_SIZE);
+}
@@ -841,9 +841,10 @@ createparamtable(void)
     setsparam("HOST", ztrdup_metafy(hostnam));
     zfree(hostnam, 256);
 
-    setsparam("LOGNAME",
-	      ztrdup_metafy((str = getlogin()) && *str ?
-			    str : cached_username));
+    /* getlogin() is slow, and an inherited LOGNAME replaces it anyway */
+    if (!(str = zgetenv("LOGNAME")) && !((str = getlogin()) && *str))
+	str = get_username();
+    setsparam("LOGNAME", ztrdup_metafy(str));
 
 #if !defined(HAVE_PUTENV) && !defined(USE_SET_UNSET_ENV)
     /* Copy the environment variables we are inheriting to dynamic *
@@ -870,12 +871,19 @@ createparamtable(void)
 		/*
 		 * Parameters that aren't already in the parameter table
 		 * aren't special to the shell, so it's always OK to
-		 * import.  Otherwise, check parameter flags.
+		 * import, and we can create them directly rather than
+		 * going through a full assignment.  Otherwise, check
+		 * parameter flags.
 		 */
-		if ((!(pm = (Param) paramtab->getnode(paramtab, iname)) ||
-		     !dontimport(pm->node.flags)) &&
-		    (pm = assignsparam(iname, metafy(ivalue, -1, META_DUP),
-				       ASSPM_ENV_IMPORT))) {
+		if (!(pm = (Param) paramtab->getnode(paramtab, iname))) {
+		    if ((pm = createparam(iname, PM_SCALAR)))
+			pm->gsu.s->setfn(pm, metafy(ivalue, -1, META_DUP));
+		} else if (dontimport(pm->node.flags))
+		    pm = NULL;
+		else
+		    pm = assignsparam(iname, metafy(ivalue, -1, META_DUP),
+				      ASSPM_ENV_IMPORT);
+		if (pm) {
 		    pm->node.flags |= PM_EXPORTED;
 		    if (pm->node.flags & PM_SPECIAL)
 			pm->env = mkenvstr (pm->node.nam,
@@ -4601,6 +4609,9 @@ setlang(char *x)
     for (ln = lc_names; ln->name; ln++)
 	if ((x = getsparam_u(ln->name)) && *x)
 	    setlocale(ln->category, x);
+#ifdef MULTIBYTE_SUPPORT
+    wcwidth_reset();
+#endif
     unqueue_signals();
 }
 
@@ -4622,8 +4633,12 @@ lc_allsetfn(Param pm, char *x)
 	    unqueue_signals();
 	}
     }
-    else
+    else {
 	setlocale(LC_ALL, unmeta(x));
+#ifdef MULTIBYTE_SUPPORT
+	wcwidth_reset();
+#endif
+    }
 }
 
 /**/
@@ -4658,6 +4673,9 @@ lcsetfn(Param pm, char *x)
 	for (ln = lc_names; ln->name; ln++)
 	    if (!strcmp(ln->name, pm->node.nam))
 		setlocale(ln->category, unmeta(x));
+#ifdef MULTIBYTE_SUPPORT
+	wcwidth_reset();
+#endif
     }
     unqueue_signals();
 }
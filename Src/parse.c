@@ -55,23 +55,23 @@ mod_export int inredir;
  */
  
 /**/
-int incasepat;
+mod_export int incasepat;
  
 /* != 0 if we just read a newline */
  
 /**/
-int isnewlin;
+mod_export int isnewlin;
 
 /* != 0 if we are after a for keyword */
 
 /**/
-int infor;
+mod_export int infor;
 
 /* != 0 if we are after a repeat keyword; if it's nonzero it's a 1-based index
  * of the current token from the last-seen command position */
 
 /**/
-int inrepeat_; /* trailing underscore because of name clash with Zle/zle_vi.c */
+mod_export int inrepeat_; /* trailing underscore because of name clash with Zle/zle_vi.c */
 
 /* != 0 if parsing arguments of typeset etc. */
 
@@ -81,7 +81,7 @@ mod_export int intypeset;
 /* list of here-documents */
 
 /**/
-struct heredocs *hdocs;
+mod_export struct heredocs *hdocs;
  
 
 #define YYERROR(O)  { tok = LEXERR; ecused = (O); return 0; }
@@ -3547,6 +3547,128 @@ build_cur_dump(char *nam, char *dump, char **names, int match, int map,
     return 0;
 }
 
+/*
+ * Write the n commands saved from a script to the wordcode file
+ * dump.zwc, each as an entry with the corresponding name.  The file is
+ * written under a temporary name and renamed, so a shell reading it at
+ * the same time never sees it half written.  Returns non-zero on
+ * failure.
+ */
+
+/**/
+int
+write_script_dump(char *dump, char **names, Eprog *progs, int n)
+{
+    LinkList lprogs = newlinklist();
+    WCFunc wcf;
+    char *tmp, pidbuf[DIGBUFSIZE];
+    int dfd, i, hlen = FD_PRELEN, tlen = 0;
+
+    for (i = 0; i < n; i++) {
+	wcf = (WCFunc) zhalloc(sizeof(*wcf));
+	wcf->name = names[i];
+	wcf->prog = progs[i];
+	wcf->flags = 0;
+	addlinknode(lprogs, wcf);
+
+	hlen += (sizeof(struct fdhead) / sizeof(wordcode)) +
+	    (strlen(names[i]) + sizeof(wordcode)) / sizeof(wordcode);
+	tlen += (progs[i]->len - (progs[i]->npats * sizeof(Patprog)) +
+		 sizeof(wordcode) - 1) / sizeof(wordcode);
+    }
+    tlen = (tlen + hlen) * sizeof(wordcode);
+
+    sprintf(pidbuf, ".%ld", (long)getpid());
+    dump = dyncat(dump, FD_EXT);
+    tmp = dyncat(dump, pidbuf);
+    if ((dfd = open(tmp, O_WRONLY|O_CREAT|O_EXCL|O_NOCTTY, 0600)) < 0)
+	return 1;
+    /* Never mapped, as it's read in one go by read_script_dump() */
+    write_dump(dfd, lprogs, 0, hlen, tlen);
+    if (close(dfd) || rename(tmp, dump)) {
+	unlink(tmp);
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * Read back a file written by write_script_dump().  The file must
+ * belong to us and not be writable by anyone else, and must have been
+ * written by this version of the shell on a machine with the same byte
+ * order.  Returns the number of entries, with their names and code in
+ * *namesp and *progsp, all in permanent storage, or -1 on failure.
+ */
+
+/**/
+int
+read_script_dump(char *dump, char ***namesp, Eprog **progsp)
+{
+    Wordcode d;
+    FDHead h, e;
+    struct stat st;
+    char **names;
+    Eprog *progs, prog;
+    Patprog *pp;
+    int fd, n, i, np, po, len;
+
+    dump = dyncat(dump, FD_EXT);
+    if ((fd = open(dump, O_RDONLY|O_NOCTTY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	st.st_uid != geteuid() || (st.st_mode & 022) ||
+	(len = st.st_size) < (FD_PRELEN + 1) * (int)sizeof(wordcode)) {
+	close(fd);
+	return -1;
+    }
+    d = (Wordcode) zalloc(len);
+    if (read(fd, d, len) != len || fdmagic(d) != FD_MAGIC ||
+	strcmp(fdversion(d), ZSH_VERSION) ||
+	fdheaderlen(d) * sizeof(wordcode) > (size_t)len) {
+	close(fd);
+	zfree(d, len);
+	return -1;
+    }
+    close(fd);
+
+    e = (FDHead) (d + fdheaderlen(d));
+    for (n = 0, h = firstfdhead(d); h < e; h = nextfdhead(h), n++) {
+	if (!h->hlen || (size_t)fdother(d) > (size_t)len ||
+	    h->start * sizeof(wordcode) + h->len > (size_t)fdother(d) ||
+	    h->strs > h->len) {
+	    zfree(d, len);
+	    return -1;
+	}
+    }
+    names = (char **) zalloc(n * sizeof(char *));
+    progs = (Eprog *) zalloc(n * sizeof(Eprog));
+    for (i = 0, h = firstfdhead(d); h < e; h = nextfdhead(h), i++) {
+	names[i] = ztrdup(fdname(h));
+	po = h->npats * sizeof(Patprog);
+	pp = (Patprog *) zalloc(h->len + po);
+	memcpy(((char *) pp) + po, d + h->start, h->len);
+
+	prog = progs[i] = (Eprog) zalloc(sizeof(*prog));
+	prog->flags = EF_REAL;
+	prog->len = h->len + po;
+	prog->npats = np = h->npats;
+	prog->nref = 1;
+	prog->pats = pp;
+	prog->prog = (Wordcode) (((char *) pp) + po);
+	prog->strs = ((char *) prog->prog) + h->strs;
+	prog->shf = NULL;
+	prog->dump = NULL;
+
+	while (np--)
+	    *pp++ = dummy_patprog1;
+    }
+    zfree(d, len);
+
+    *namesp = names;
+    *progsp = progs;
+    return n;
+}
+
 /**/
 #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(HAVE_MUNMAP)
 
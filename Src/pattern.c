@@ -505,7 +505,7 @@ patcompcharsset(void)
 /* Called before parsing a set of file matches to initialize flags */
 
 /**/
-void
+mod_export void
 patcompstart(void)
 {
     patcompcharsset();
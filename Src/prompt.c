@@ -952,7 +952,21 @@ stradd(char *d)
     while (upslen > 0) {
 	wchar_t cc;
 	char *pc;
-	size_t cnt = eol ? MB_INVALID : mbrtowc(&cc, ups, upslen, &mbs);
+	size_t cnt;
+
+	/* Printable ASCII stands for itself; copy it straight across. */
+	if (!eol && mbsinit(&mbs) && *ups >= ' ' && *ups <= '~') {
+	    for (cnt = 1; cnt < upslen && ups[cnt] >= ' ' && ups[cnt] <= '~';
+		 cnt++)
+		;
+	    addbufspc(cnt);
+	    memcpy(bv->bp, ups, cnt);
+	    bv->bp += cnt;
+	    upslen -= cnt;
+	    ups += cnt;
+	    continue;
+	}
+	cnt = eol ? MB_INVALID : mbrtowc(&cc, ups, upslen, &mbs);
 
 	switch (cnt) {
 	case MB_INCOMPLETE:
@@ -1147,6 +1161,12 @@ countprompt(char *str, int *wp, int *hp, int overf)
 		}
 
 		inchar = *str;
+		if (!multi && STOUC(inchar) >= 0x20 && STOUC(inchar) < 0x7f) {
+		    /* Printable ASCII: no need to convert it. */
+		    wcw = 1;
+		    w++;
+		    continue;
+		}
 #endif
 	    }
 
@@ -2078,13 +2098,13 @@ set_colour_attribute(zattr atr, int fg_bg, int flags)
 		    addbufspc(1);
 		    *bv->bp++ = Inpar;
 		}
-		tputs(tgoto(tcstr[tc], colour, colour), 1, putstr);
+		tputs(tcgoto(tc, colour), 1, putstr);
 		if (!bv->dontcount) {
 		    addbufspc(1);
 		    *bv->bp++ = Outpar;
 		}
 	    } else {
-		tputs(tgoto(tcstr[tc], colour, colour), 1, putshout);
+		tputs(tcgoto(tc, colour), 1, putshout);
 	    }
 	    /* That worked. */
 	    return;
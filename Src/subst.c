@@ -1585,6 +1585,67 @@ check_colon_subscript(char *str, char **endp)
     return str;
 }
 
+/*
+ * Copy the sl bytes at str to buf, surrounded by pre and post
+ * characters of the quotes for quotetype.  buf must have room for
+ * pre + sl + post + 1 bytes.  Returns the position after the NULL.
+ */
+
+/**/
+static char *
+addquotes(char *buf, char *str, int sl, int quotetype, int pre, int post)
+{
+    memcpy(buf + pre, str, sl);
+    if (pre)
+	buf[pre - 1] = buf[pre + sl] =
+	    (quotetype != QT_DOUBLE ? '\'' : '"');
+    if (quotetype == QT_DOLLARS)
+	buf[0] = '$';
+    buf[pre + sl + post] = '\0';
+    return buf + pre + sl + post + 1;
+}
+
+/*
+ * Quote each element of the array ap for the (q) flags.  Most elements
+ * don't need changing: these are copied into a single buffer rather
+ * than being passed through the quoting code one by one.
+ */
+
+/**/
+static void
+quotearray(char **ap, int quotetype, int pre, int post)
+{
+    char **pp, *buf;
+    int sl, tot = 0;
+
+    if (quotetype == QT_QUOTEDZPUTS || quotetype <= QT_BACKSLASH)
+	pre = post = 0;
+
+    for (pp = ap; *pp; pp++)
+	if ((sl = quoteplainlen(*pp)) >= 0)
+	    tot += pre + sl + post + 1;
+    buf = tot ? (char *) zhalloc(tot) : NULL;
+
+    for (pp = ap; *pp; pp++) {
+	if ((sl = quoteplainlen(*pp)) >= 0) {
+	    char *next = addquotes(buf, *pp, sl, quotetype, pre, post);
+
+	    *pp = buf;
+	    buf = next;
+	} else if (quotetype == QT_QUOTEDZPUTS)
+	    *pp = quotedzputs(*pp, NULL);
+	else if (quotetype <= QT_BACKSLASH)
+	    *pp = quotestring(*pp, QT_BACKSLASH_SHOWNULL);
+	else {
+	    char *tmp = quotestring(*pp, quotetype);
+
+	    sl = strlen(tmp);
+	    *pp = (char *) zhalloc(pre + sl + post + 1);
+	    addquotes(*pp, tmp, sl, quotetype, pre, post);
+	}
+    }
+}
+
 /* parameter substitution */
 
 #define	isstring(c) ((c) == '$' || (char)(c) == String || (char)(c) == Qstring)
@@ -3445,10 +3506,13 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 		    char **pp = aval = (char **) hcalloc(sizeof(char *) *
 							 (arrlen(aval) + 1));
 
+		    /* elements often share directories for :A */
+		    beginresolvebatch();
 		    while ((*pp = *ap++)) {
 			ss = s;
 			modify(pp++, &ss, inbrace);
 		    }
+		    endresolvebatch();
 		    if (pp == aval) {
 			char *t = "";
 			ss = s;
@@ -3726,28 +3790,7 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 	    ap = aval;
 
 	    if (quotemod > 0) {
-		if (quotetype == QT_QUOTEDZPUTS) {
-		    for (; *ap; ap++)
-			*ap = quotedzputs(*ap, NULL);
-		} else if (quotetype > QT_BACKSLASH) {
-		    int sl;
-		    char *tmp;
-
-		    for (; *ap; ap++) {
-			tmp = quotestring(*ap, quotetype);
-			sl = strlen(tmp);
-			*ap = (char *) zhalloc(pre + sl + post + 1);
-			strcpy((*ap) + pre, tmp);
-			if (pre)
-			    ap[0][pre - 1] = ap[0][pre + sl] =
-				(quotetype != QT_DOUBLE ? '\'' : '"');
-			ap[0][pre + sl + post] = '\0';
-			if (quotetype == QT_DOLLARS)
-			  ap[0][0] = '$';
-		    }
-		} else
-		    for (; *ap; ap++)
-			*ap = quotestring(*ap, QT_BACKSLASH_SHOWNULL);
+		quotearray(ap, quotetype, pre, post);
 	    } else {
 		int one = noerrs, oef = errflag, haserr = 0;
 
@@ -3775,18 +3818,11 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 		if (quotetype == QT_QUOTEDZPUTS) {
 		    val = quotedzputs(val, NULL);
 		} else if (quotetype > QT_BACKSLASH) {
-		    int sl;
-		    char *tmp;
-		    tmp = quotestring(val, quotetype);
-		    sl = strlen(tmp);
+		    char *tmp = quotestring(val, quotetype);
+		    int sl = strlen(tmp);
+
 		    val = (char *) zhalloc(pre + sl + post + 1);
-		    strcpy(val + pre, tmp);
-		    if (pre)
-			val[pre - 1] = val[pre + sl] =
-			    (quotetype != QT_DOUBLE ? '\'' : '"');
-		    val[pre + sl + post] = '\0';
-		    if (quotetype == QT_DOLLARS)
-		      val[0] = '$';
+		    addquotes(val, tmp, sl, quotetype, pre, post);
 		} else
 		    val = quotestring(val, QT_BACKSLASH_SHOWNULL);
 	    } else {
@@ -30,6 +30,10 @@
 #include "zsh.mdh"
 #include "utils.pro"
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MEMFD_CREATE)
+#include <sys/mman.h>
+#endif
+
 /* name of script being sourced */
 
 /**/
@@ -143,6 +147,10 @@ zwarning(const char *cmd, const char *fmt, va_list ap)
 
     char *prefix = scriptname ? scriptname : (argzero ? argzero : "");
 
+    /* Keep the order with any xtrace output on the same line */
+    if (xtrerr && xtrerr != stderr)
+	fflush(xtrerr);
+
     if (cmd) {
 	if (unset(SHINSTDIN) || locallevel) {
 	    nicezputs(prefix, stderr);
@@ -792,6 +800,59 @@ zwcwidth(wint_t wc)
     return wcw;
 }
 
+#ifndef ENABLE_UNICODE9
+/*
+ * Widths returned by wcwidth(), filled in a page of 256 characters
+ * at a time the first time a character in the page is looked up.
+ * They depend on the locale, so wcwidth_reset() is called when that
+ * changes.
+ */
+#define WCWIDTH_NPAGES	(0x110000 >> 8)
+static signed char *wcwidth_pages[WCWIDTH_NPAGES];
+#endif
+
+/**/
+mod_export int
+wcwidth_lookup(wchar_t wc)
+{
+#ifdef ENABLE_UNICODE9
+    return u9_wcwidth(wc);
+#else
+    signed char *page;
+    wchar_t base;
+    int i;
+
+    if ((unsigned long)wc >= (WCWIDTH_NPAGES << 8))
+	return wcwidth(wc);
+    if (!(page = wcwidth_pages[wc >> 8])) {
+	page = (signed char *)zalloc(256);
+	base = wc & ~(wchar_t)0xff;
+	for (i = 0; i < 256; i++)
+	    page[i] = wcwidth(base + i);
+	wcwidth_pages[wc >> 8] = page;
+    }
+    return page[wc & 0xff];
+#endif
+}
+
+/**/
+void
+wcwidth_reset(void)
+{
+#ifndef ENABLE_UNICODE9
+    int i;
+
+    queue_signals();
+    for (i = 0; i < WCWIDTH_NPAGES; i++) {
+	if (wcwidth_pages[i]) {
+	    zfree(wcwidth_pages[i], 256);
+	    wcwidth_pages[i] = NULL;
+	}
+    }
+    unqueue_signals();
+#endif
+}
+
 /**/
 #endif /* MULTIBYTE_SUPPORT */
 
@@ -910,6 +971,206 @@ slashsplit(char *s)
     return r;
 }
 
+/*
+ * Cache of directories whose symbolic links have been resolved, shared
+ * by xsymlinks(), the :A modifier and cd.  Each entry is keyed by the
+ * path as it was given and holds the path with links resolved.  Both
+ * must still lead to the same directory, checked by device and inode,
+ * and no component of the resolved path may have become a link, for
+ * the entry to be used.  So changes to links or renaming of directories
+ * are noticed with a stat() for each component rather than resolving
+ * each one again.
+ */
+
+struct resolveddir {
+    struct hashnode node;
+    char *path;			/* the path with links resolved */
+    dev_t dev;			/* the directory they both lead to */
+    ino_t ino;
+    zlong checked;		/* resolvebatch when last checked */
+};
+
+#define RESOLVEDDIR_MAX 256
+
+static HashTable resolveddirtab;
+
+/*
+ * Non-zero while resolving a batch of paths, such as the elements of
+ * an array for :A, during which entries need only be checked once.
+ */
+
+static zlong resolvebatch, resolvebatchgen;
+static int resolvebatchdepth;
+
+/**/
+static void
+freeresolveddir(HashNode hn)
+{
+    struct resolveddir *rd = (struct resolveddir *)hn;
+
+    zsfree(rd->node.nam);
+    zsfree(rd->path);
+    zfree(rd, sizeof(*rd));
+}
+
+/**/
+static HashTable
+newresolveddirtable(void)
+{
+    HashTable ht = newhashtable(31, "resolveddirtab", NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = freeresolveddir;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
+/*
+ * Check that path (unmetafied) is still free of symbolic links and
+ * leads to the directory with the given device and inode.  A stat()
+ * of the whole path would follow a link that had replaced one of its
+ * components since it was cached.
+ */
+
+/**/
+static int
+resolveddirok(char *path, dev_t dev, ino_t ino)
+{
+    struct stat st;
+    char *p;
+
+    for (p = path + 1; ; p++) {
+	if (*p && *p != '/')
+	    continue;
+	if (*p) {
+	    *p = '\0';
+	    if (lstat(path, &st) < 0 || S_ISLNK(st.st_mode)) {
+		*p = '/';
+		return 0;
+	    }
+	    *p = '/';
+	} else
+	    return !lstat(path, &st) &&
+		st.st_dev == dev && st.st_ino == ino;
+    }
+}
+
+/*
+ * Return the directory dir (metafied, absolute) with symbolic links
+ * resolved if it is in the cache and still valid, else NULL.
+ */
+
+/**/
+char *
+getresolveddir(char *dir)
+{
+    struct resolveddir *rd;
+    struct stat st;
+
+    if (!resolveddirtab ||
+	!(rd = (struct resolveddir *)
+	  resolveddirtab->getnode(resolveddirtab, dir)))
+	return NULL;
+    if (resolvebatch && rd->checked == resolvebatch)
+	return rd->path;
+    if (stat(unmeta(dir), &st) ||
+	st.st_dev != rd->dev || st.st_ino != rd->ino ||
+	!resolveddirok(unmeta(rd->path), rd->dev, rd->ino)) {
+	resolveddirtab->freenode(resolveddirtab->removenode(resolveddirtab,
+							   dir));
+	return NULL;
+    }
+    rd->checked = resolvebatch;
+    return rd->path;
+}
+
+/*
+ * Remember that dir resolves to path, if that is a directory.
+ */
+
+/**/
+void
+addresolveddir(char *dir, char *path)
+{
+    struct resolveddir *rd;
+    struct stat st;
+
+    if (*dir != '/' || !dir[1] || *path != '/' || !path[1] ||
+	stat(unmeta(path), &st) || !S_ISDIR(st.st_mode))
+	return;
+    if (!resolveddirtab)
+	resolveddirtab = newresolveddirtable();
+    else if (resolveddirtab->ct >= RESOLVEDDIR_MAX)
+	resolveddirtab->emptytable(resolveddirtab);
+    rd = (struct resolveddir *) zshcalloc(sizeof(*rd));
+    rd->path = ztrdup(path);
+    rd->dev = st.st_dev;
+    rd->ino = st.st_ino;
+    rd->checked = resolvebatch;
+    resolveddirtab->addnode(resolveddirtab, ztrdup(dir), rd);
+}
+
+/*
+ * Bracket the resolution of a set of paths assumed not to change
+ * while they are being resolved.
+ */
+
+/**/
+void
+beginresolvebatch(void)
+{
+    if (!resolvebatchdepth++)
+	resolvebatch = ++resolvebatchgen;
+}
+
+/**/
+void
+endresolvebatch(void)
+{
+    if (!--resolvebatchdepth)
+	resolvebatch = 0;
+}
+
+/*
+ * Find the longest leading part of the path with components pp,
+ * excluding the last, that is in the cache.  Put the resolved form
+ * in xbuf and return the number of components it covers, or return
+ * 0 if there isn't one.  dir is the path of all but the last
+ * component, which is restored before returning.
+ */
+
+/**/
+static int
+xsymlinksprefix(char *dir, int ncomp)
+{
+    char *end = dir + strlen(dir), *ptr = end, *res;
+
+    for (;;) {
+	res = getresolveddir(dir);
+	if (ptr != end)
+	    *ptr = '/';
+	if (res) {
+	    strcpy(xbuf, res);
+	    return ncomp;
+	}
+	if (!--ncomp)
+	    return 0;
+	while (*--ptr != '/')
+	    ;
+	*ptr = '\0';
+    }
+}
+
 /* expands symlinks and .. or . expressions */
 
 /**/
@@ -918,11 +1179,37 @@ xsymlinks(char *s, int full)
 {
     char **pp, **opp;
     char xbuf2[PATH_MAX*3+1], xbuf3[PATH_MAX*2+1];
+    char *dir = NULL, *resdir = NULL;
     int t0, ret = 0;
-    zulong xbuflen = strlen(xbuf), pplen;
+    zulong xbuflen, pplen;
 
     opp = pp = slashsplit(s);
+    /*
+     * When resolving a whole path from the root, start from the
+     * longest leading directory that was resolved before, and
+     * remember the directory containing the last component.
+     */
+    if (full && !*xbuf && *pp && pp[1]) {
+	int ncomp = arrlen(pp) - 1;
+	char *ptr;
+
+	for (t0 = 0, pplen = 1; t0 < ncomp; t0++)
+	    pplen += strlen(pp[t0]) + 1;
+	ptr = dir = (char *) zalloc(pplen);
+	for (t0 = 0; t0 < ncomp; t0++) {
+	    *ptr++ = '/';
+	    strucpy(&ptr, pp[t0]);
+	}
+	if ((t0 = xsymlinksprefix(dir, ncomp)) == ncomp) {
+	    zsfree(dir);
+	    dir = NULL;
+	}
+	pp += t0;
+    }
+    xbuflen = strlen(xbuf);
     for (; xbuflen < sizeof(xbuf) && *pp && ret >= 0; pp++) {
+	if (dir && !pp[1])
+	    resdir = ztrdup(xbuf);
 	if (!strcmp(*pp, "."))
 	    continue;
 	if (!strcmp(*pp, "..")) {
@@ -1011,6 +1298,12 @@ xsymlinks(char *s, int full)
 		    xbuflen = strlen(xbuf);
 	}
     }
+    if (dir) {
+	if (resdir && ret >= 0)
+	    addresolveddir(dir, resdir);
+	zsfree(dir);
+	zsfree(resdir);
+    }
     freearray(opp);
     return ret;
 }
@@ -1104,7 +1397,8 @@ substnamedir(char *s)
 
 /* Returns the current username.  It caches the username *
  * and uid to try to avoid requerying the password files *
- * or NIS/NIS+ database.                                 */
+ * or NIS/NIS+ database.  The username isn't looked up   *
+ * until it's first needed.                              */
 
 /**/
 uid_t cached_uid;
@@ -1120,7 +1414,7 @@ get_username(void)
     uid_t current_uid;
 
     current_uid = getuid();
-    if (current_uid != cached_uid) {
+    if (current_uid != cached_uid || !cached_username) {
 	cached_uid = current_uid;
 	zsfree(cached_username);
 	if ((pswd = getpwuid(current_uid)))
@@ -1764,8 +2058,17 @@ printprompt4(void)
 	xtrerr = stderr;
     if (prompt4) {
 	int l, t = opts[XTRACE];
-	char *s = dupstring(prompt4);
+	char *s;
+
+	/* Skip expansion if there is nothing to expand */
+	if (!strchr(prompt4, '%') &&
+	    (unset(PROMPTSUBST) || !strpbrk(prompt4, "$`\\")) &&
+	    (unset(PROMPTBANG) || !strchr(prompt4, '!'))) {
+	    fputs(unmeta(prompt4), xtrerr);
+	    return;
+	}
 
+	s = dupstring(prompt4);
 	opts[XTRACE] = 0;
 	unmetafy(s, &l);
 	s = unmetafy(promptexpand(metafy(s, l, META_NOALLOC),
@@ -2282,6 +2585,27 @@ gettempfile(const char *prefix, int use_heap, char **tempname)
     return fd;
 }
 
+/*
+ * Get a file descriptor for an anonymous file held in memory, open
+ * for reading and writing.  Such a file has no name, so there is
+ * nothing to clean up, but otherwise it behaves like a temporary
+ * file; in particular, it is seekable.  The name is only used for
+ * debugging purposes.  Returns -1 if the system can't provide this,
+ * in which case the caller should fall back to gettempfile().
+ */
+
+/**/
+mod_export int
+getmemfile(const char *name)
+{
+#ifdef HAVE_MEMFD_CREATE
+    return memfd_create(name, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 /* Check if a string contains a token */
 
 /**/
@@ -5173,9 +5497,19 @@ zreaddir(DIR *dir, int ignoredots)
 mod_export int
 zputs(char const *s, FILE *stream)
 {
+    char const *t;
     int c;
 
     while (*s) {
+	/* Write runs of characters needing no conversion in one go */
+	for (t = s; *t && *t != Meta && !itok(*t); t++)
+	    ;
+	if (t > s) {
+	    if (fwrite(s, 1, t - s, stream) != (size_t)(t - s))
+		return EOF;
+	    s = t;
+	    continue;
+	}
 	if (*s == Meta)
 	    c = *++s ^ 32;
 	else if(itok(*s)) {
@@ -5413,6 +5747,12 @@ is_mb_niceformat(const char *s)
     char *ums, *ptr;
     mbstate_t mbs;
 
+    /* Printable ASCII is never reformatted: no need to convert */
+    for (ptr = (char *)s; STOUC(*ptr) >= 0x20 && STOUC(*ptr) < 0x7f; ptr++)
+	;
+    if (!*ptr)
+	return 0;
+
     ums = ztrdup(s);
     untokenize(ums);
     ptr = unmetafy(ums, &umlen);
@@ -5895,6 +6235,28 @@ hasspecial(char const *s)
     return 0;
 }
 
+/*
+ * If none of the forms of quoting done by quotestring() and
+ * quotedzputs() would change s, return its length, else -1.  This is
+ * so for a non-empty string of printable ASCII characters that aren't
+ * special to the shell, which covers most strings in practice, and
+ * is quick to check.
+ */
+
+/**/
+mod_export int
+quoteplainlen(char const *s)
+{
+    char const *t;
+    int c;
+
+    for (t = s; (c = STOUC(*t)); t++) {
+	if (c < 0x20 || c > 0x7e || ispecial(c) || c == bangchar)
+	    return -1;
+    }
+    return t > s ? t - s : -1;
+}
+
 
 static char *
 addunprintable(char *v, const char *u, const char *uend)
@@ -5975,6 +6337,8 @@ quotestring(const char *s, int instring)
     convchar_t cc;
     const char *uend;
 
+    if (quoteplainlen(s) >= 0)
+	return dupstring(s);
     slen = strlen(s);
     switch (instring)
     {
@@ -6291,6 +6655,13 @@ quotedzputs(char const *s, FILE *stream)
 	return NULL;
     }
 
+    if ((c = quoteplainlen(s)) >= 0) {
+	if (!stream)
+	    return dupstring(s);
+	fwrite(s, 1, c, stream);
+	return NULL;
+    }
+
 #ifdef MULTIBYTE_SUPPORT
     if (is_mb_niceformat(s)) {
 	if (stream) {
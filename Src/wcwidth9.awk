@@ -0,0 +1,156 @@
+#
+# {g,n,m}awk script to generate wcwidth9tab.h from wcwidth9.h.
+#
+# The interval tables in wcwidth9.h are turned into a two-level
+# table giving the width of every code point as u9_wcwidth() would
+# return it, i.e. -1 for a character that isn't printable, 0 for a
+# combining character, and otherwise 1 or 2.  wcwidth9_stage1 is
+# indexed by the code point divided by 256 and gives the row of
+# wcwidth9_stage2 holding the widths for that page; identical pages
+# share a row.
+#
+# Without 0 + hacks some nawks compare numbers as strings
+#
+
+function hex(s,    i, n, c) {
+    n = 0
+    s = tolower(s)
+    sub(/^0x/, "", s)
+    for (i = 1; i <= length(s); i++) {
+	c = index("0123456789abcdef", substr(s, i, 1))
+	if (c == 0)
+	    break
+	n = n * 16 + c - 1
+    }
+    return n
+}
+
+# Finish the current page, with key either "u" followed by the
+# width for a uniform page or the list of widths.
+function endpage(key) {
+    if (!(key in row)) {
+	row[key] = nrows
+	rowkey[nrows] = key
+	nrows++
+    }
+    stage1[npages++] = row[key]
+    buf = ""
+    bufn = 0
+}
+
+/^static const struct wcwidth9_interval wcwidth9_[a-z_]*\[\] = \{/ {
+    tab = $0
+    sub(/^static const struct wcwidth9_interval wcwidth9_/, "", tab)
+    sub(/\[.*/, "", tab)
+    n[tab] = 0
+    next
+}
+
+tab != "" && /^[\t ]*\{0x[0-9a-fA-F]*, *0x[0-9a-fA-F]*\},/ {
+    line = $0
+    gsub(/[{},]/, " ", line)
+    split(line, f)
+    i = ++n[tab]
+    first[tab, i] = hex(f[1])
+    last[tab, i] = hex(f[2])
+    next
+}
+
+/^\};/ { tab = "" }
+
+END {
+    # The order in which wcwidth9() tests the tables, and the
+    # resulting widths after u9_wcwidth() has turned the private
+    # and ambiguous classes into 1.
+    ntabs = split("nonprint combining not_assigned private ambiguous doublewidth emoji_width", order)
+    split("-1 0 -1 1 1 2 2", width)
+    for (t = 1; t <= ntabs; t++) {
+	if (n[order[t]] == 0) {
+	    print "wcwidth9.awk: table " order[t] " not found" > "/dev/stderr"
+	    exit 1
+	}
+	ptr[t] = 1
+    }
+
+    maxcp = 1114112		# 0x110000
+    npages = nrows = bufn = 0
+    buf = ""
+    c = 0
+    while (c < maxcp) {
+	# Find the width at c and the first code point where that may change.
+	if (c == 0) {
+	    w = 0
+	    next_c = 1
+	} else {
+	    w = 1
+	    found = 0
+	    next_c = maxcp
+	    for (t = 1; t <= ntabs; t++) {
+		tn = order[t]
+		while (ptr[t] <= 0 + n[tn] && 0 + last[tn, ptr[t]] < c)
+		    ptr[t]++
+		if (ptr[t] > 0 + n[tn])
+		    continue
+		if (0 + first[tn, ptr[t]] <= c) {
+		    if (!found) {
+			w = width[t]
+			found = 1
+		    }
+		    if (last[tn, ptr[t]] + 1 < next_c)
+			next_c = last[tn, ptr[t]] + 1
+		} else if (0 + first[tn, ptr[t]] < next_c)
+		    next_c = first[tn, ptr[t]]
+	    }
+	}
+	# Spread the run [c, next_c) over the pages it touches.
+	while (c < next_c) {
+	    pend = c - c % 256 + 256
+	    e = next_c < pend ? next_c : pend
+	    if (bufn == 0 && e == pend)
+		endpage("u" w)
+	    else {
+		for (; c < e; c++) {
+		    buf = buf (bufn % 16 ? " " : "\n    ") w ","
+		    bufn++
+		}
+		if (e == pend)
+		    endpage(buf)
+	    }
+	    c = e
+	}
+    }
+
+    print "/* Generated by wcwidth9.awk from wcwidth9.h: do not edit. */"
+    print ""
+    print "#define WCWIDTH9_PAGE_SHIFT 8"
+    print "#define WCWIDTH9_PAGE_MASK 0xff"
+    print "#define WCWIDTH9_MAX 0x10ffff"
+    print ""
+    print "static const " (nrows > 256 ? "unsigned short" : "unsigned char") \
+	" wcwidth9_stage1[" npages "] = {"
+    line = "   "
+    for (p = 0; p < npages; p++) {
+	line = line " " stage1[p] ","
+	if (p % 16 == 15) {
+	    print line
+	    line = "   "
+	}
+    }
+    if (line != "   ")
+	print line
+    print "};"
+    print ""
+    print "static const signed char wcwidth9_stage2[" nrows "][256] = {"
+    for (r = 0; r < nrows; r++) {
+	key = rowkey[r]
+	if (substr(key, 1, 1) == "u") {
+	    w = substr(key, 2)
+	    key = ""
+	    for (i = 0; i < 256; i++)
+		key = key (i % 16 ? " " : "\n    ") w ","
+	}
+	print "  {" key
+	print "  },"
+    }
+    print "};"
+}
@@ -3234,6 +3234,21 @@ enum zexit_t {
 #define BEFORETRAPHOOK (zshhooks + 1)
 #define AFTERTRAPHOOK  (zshhooks + 2)
 #define GETCOLORATTR   (zshhooks + 3)
+#define BEFORECMDHOOK  (zshhooks + 4)
+#define AFTERCMDHOOK   (zshhooks + 5)
+
+/*
+ * Passed to functions on the before_command and after_command hooks,
+ * which are run around each sublist at the same points as the DEBUG
+ * trap.  Text for the command is getpermtext(prog, pc, 0).
+ */
+
+struct cmdhookdata {
+    Eprog prog;			/* program being executed */
+    Wordcode pc;		/* start of the command */
+    zlong lineno;		/* line number of the command */
+    int status;			/* status after the command (after_command) */
+};
 
 #ifdef MULTIBYTE_SUPPORT
 /* Final argument to mb_niceformat() */
@@ -3268,10 +3283,18 @@ typedef wint_t convchar_t;
  * works on MacOS which doesn't define that.
  */
 #ifdef ENABLE_UNICODE9
-#define WCWIDTH(wc)	u9_wcwidth(wc)
+#define WCWIDTH_LOOKUP(wc)	u9_wcwidth(wc)
 #else
-#define WCWIDTH(wc)	wcwidth(wc)
+#define WCWIDTH_LOOKUP(wc)	wcwidth_lookup(wc)
 #endif
+/*
+ * Printable ASCII always has width 1 and the rest of ASCII
+ * apart from NUL isn't printable, so runs of ASCII don't need
+ * to look anything up.  wc may be evaluated more than once.
+ */
+#define WCWIDTH(wc)	((unsigned long)(wc) < 0x7f ? \
+			 ((wc) >= 0x20 ? 1 : (wc) ? -1 : 0) : \
+			 WCWIDTH_LOOKUP(wc))
 /*
  * Note WCWIDTH_WINT() takes wint_t, typically as a convchar_t.
  * It's written to use the wint_t from mb_metacharlenconv() without